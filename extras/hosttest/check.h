@@ -0,0 +1,26 @@
+// Tiny assertion helpers for the host tests.
+#pragma once
+
+#include <stdio.h>
+
+static int checksFailed = 0;
+
+#define CHECK(cond) do { \
+	if (! (cond)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		checksFailed++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long _a = (long long)(a), _b = (long long)(b); \
+	if (_a != _b) { \
+		printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		checksFailed++; \
+	} \
+} while (0)
+
+static inline int checkResult(const char *name){
+	printf("%s: %s\n", name, checksFailed ? "FAILED" : "ok");
+	return checksFailed ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+// Host shim: just enough of the Arduino core to compile & test Picomix on a computer.
+// Nothing here runs on the RP2040.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define F_CPU 133000000L
+
+typedef unsigned int uint;
+
+// like ArduinoCore-API's:
+template<class T, class L> auto min(const T& a, const L& b) -> decltype((b < a) ? b : a) { return (b < a) ? b : a; }
+template<class T, class L> auto max(const T& a, const L& b) -> decltype((b < a) ? b : a) { return (a < b) ? b : a; }
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define __not_in_flash_func(f) f
+#define __not_in_flash(group)
+
+class String {
+public:
+	String(const char *s = "") : str(s ? s : "") {}
+	String(const std::string &s) : str(s) {}
+	const char *c_str() const { return str.c_str(); }
+	unsigned int length() const { return str.length(); }
+	bool operator==(const String &o) const { return str == o.str; }
+	bool operator!=(const String &o) const { return str != o.str; }
+	String operator+(const String &o) const { return String(str + o.str); }
+private:
+	std::string str;
+};
+
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+	size_t print(const char *s) { return fputs(s, stdout) == EOF ? 0 : strlen(s); }
+	size_t println(const char *s = "") { return printf("%s\n", s); }
+	size_t printf(const char *fmt, ...);
+	void flush() { fflush(stdout); }
+	operator bool() { return true; }
+};
+
+class Stream : public Print {
+public:
+	virtual int available() { return 0; }
+	virtual int read() { return -1; }
+	// no timeouts on the host: stop as soon as read() runs dry
+	virtual size_t readBytes(char *buffer, size_t length) {
+		size_t n = 0;
+		int c;
+		while (n < length && (c = read()) >= 0)
+			buffer[n++] = (char)c;
+		return n;
+	}
+};
+
+extern Stream Serial;
+
+void randomSeed(unsigned long seed);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void delay(unsigned long ms);
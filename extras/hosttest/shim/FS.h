@@ -0,0 +1,63 @@
+// Host shim: an in-memory stand-in for the Arduino fs::FS & fs::File.
+// Tests put() files into an FS, then hand it to Picomix like LittleFS.
+#pragma once
+
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+class File : public Stream {
+public:
+	File() {}
+	File(std::shared_ptr<const std::vector<uint8_t>> d) : data(d) {}
+
+	operator bool() const { return data != nullptr; }
+	size_t size() const { return data ? data->size() : 0; }
+	size_t position() const { return pos; }
+	void close() { data = nullptr; pos = 0; }
+
+	int available() override { return data ? (int)(data->size() - pos) : 0; }
+	int read() override { return (data && pos < data->size()) ? (*data)[pos++] : -1; }
+	size_t readBytes(char *buffer, size_t length) override {
+		size_t n = min(length, (size_t)available());
+		if (n)
+			memcpy(buffer, data->data() + pos, n);
+		pos += n;
+		return n;
+	}
+	size_t read(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+private:
+	std::shared_ptr<const std::vector<uint8_t>> data;
+	size_t pos = 0;
+};
+
+class FS {
+public:
+	File open(const char *path, const char *mode = "r") {
+		opens++;
+		auto f = files.find(path);
+		if (f == files.end() || strcmp(mode, "r") != 0)
+			return File();
+		return File(f->second);
+	}
+	File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+	bool exists(const char *path) { return files.count(path) > 0; }
+
+	// (host only)
+	void put(const char *path, std::vector<uint8_t> bytes) {
+		files[path] = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+	}
+	unsigned long opens = 0;
+
+private:
+	std::map<std::string, std::shared_ptr<const std::vector<uint8_t>>> files;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,48 @@
+// Host shim for the pico-sdk: DMA channels are threads.
+// A triggered channel copies its transfers on its own thread, a few at a time, while
+// the caller carries on; dma_channel_is_busy() is true until it's done.
+// Paced (timer DREQ) channels, like PWMStreamer's, count as busy once started
+// (as they would be, chained to each other), but move no data.
+#pragma once
+
+#include "pico/stdlib.h"
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+	uint8_t size;
+	bool readIncr, writeIncr;
+	uint dreq;
+	uint chainTo;
+} dma_channel_config;
+
+#define DREQ_FORCE 0x3f
+
+typedef struct { volatile uint32_t ints0, ints1; } dma_hw_t;
+extern dma_hw_t *dma_hw;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+int dma_claim_unused_timer(bool required);
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+uint dma_get_timer_dreq(uint timer);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_transfer_data_size(dma_channel_config *c, dma_channel_transfer_size size);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+		const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_start(uint channel);
+void dma_start_channel_mask(uint32_t mask);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_abort(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+void dma_channel_acknowledge_irq0(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
@@ -0,0 +1,33 @@
+// Host shim for the pico-sdk: an interpolator that only knows clamp mode, which is all Picomix uses.
+#pragma once
+
+#include <stdint.h>
+
+typedef struct { bool clamp, is_signed; } interp_config;
+
+struct interp_hw_t {
+	int32_t acc = 0;
+	volatile int32_t base[3] = {0, 0, 0};
+
+	struct Accum {
+		interp_hw_t *hw;
+		struct Lane { interp_hw_t *hw; Lane &operator=(int32_t v) { hw->acc = v; return *this; } };
+		Lane operator[](int) { return Lane{hw}; }
+	} accum{this};
+
+	struct Peek {
+		interp_hw_t *hw;
+		int32_t operator[](int) const {
+			int32_t a = hw->acc;
+			return a < hw->base[0] ? hw->base[0] : (a > hw->base[1] ? hw->base[1] : a);
+		}
+	} peek{this};
+};
+
+extern interp_hw_t *interp0;
+extern interp_hw_t *interp1;
+
+interp_config interp_default_config();
+void interp_config_set_clamp(interp_config *c, bool clamp);
+void interp_config_set_signed(interp_config *c, bool is_signed);
+void interp_set_config(interp_hw_t *interp, uint lane, interp_config *c);
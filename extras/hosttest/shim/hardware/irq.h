@@ -0,0 +1,15 @@
+// Host shim for the pico-sdk: interrupts are just recorded, & never fire by themselves.
+#pragma once
+
+#include <stdint.h>
+
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler);
+void irq_set_enabled(unsigned num, bool enabled);
+
+// (host only) call the handler installed for an interrupt, if it's enabled
+bool host_irq_fire(unsigned num);
@@ -0,0 +1,21 @@
+// Host shim for the pico-sdk: the PWM does nothing.
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct { uint32_t csr, div, top; } pwm_config;
+typedef struct { volatile uint32_t en; } pwm_hw_t;
+extern pwm_hw_t *pwm_hw;
+
+#define PWM_BASE 0x40050000
+#define PWM_CH0_CC_OFFSET 0x0c
+
+pwm_config pwm_get_default_config();
+void pwm_config_set_wrap(pwm_config *c, uint16_t wrap);
+void pwm_init(uint slice, pwm_config *c, bool start);
+void pwm_set_irq_enabled(uint slice, bool enabled);
+void pwm_set_both_levels(uint slice, uint16_t a, uint16_t b);
+void pwm_set_counter(uint slice, uint16_t c);
+void pwm_set_enabled(uint slice, bool enabled);
+void pwm_set_mask_enabled(uint32_t mask);
+uint pwm_gpio_to_slice_num(uint gpio);
@@ -0,0 +1,205 @@
+// Host shim: implementations for the Arduino & pico-sdk stand-ins.
+
+#include "Arduino.h"
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pwm.h"
+#include "hardware/interp.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <thread>
+
+//////////
+// Arduino
+
+Stream Serial;
+
+size_t Print::printf(const char *fmt, ...){
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vprintf(fmt, ap);
+	va_end(ap);
+	return n < 0 ? 0 : n;
+}
+
+void randomSeed(unsigned long seed){ srand(seed); }
+long random(long howbig){ return howbig > 0 ? rand() % howbig : 0; }
+long random(long howsmall, long howbig){ return howsmall + random(howbig - howsmall); }
+void delay(unsigned long ms){ std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+uint32_t time_us_32(){
+	static auto t0 = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//////////
+// interrupts
+
+static irq_handler_t handlers[32];
+static bool enabled[32];
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler){ handlers[num] = handler; }
+void irq_set_enabled(unsigned num, bool on){ enabled[num] = on; }
+
+bool host_irq_fire(unsigned num){
+	if (! enabled[num] || ! handlers[num])
+		return false;
+	handlers[num]();
+	return true;
+}
+
+//////////
+// PWM & interpolators
+
+static pwm_hw_t pwmRegs;
+pwm_hw_t *pwm_hw = &pwmRegs;
+
+pwm_config pwm_get_default_config(){ return pwm_config{}; }
+void pwm_config_set_wrap(pwm_config *c, uint16_t wrap){ c->top = wrap; }
+void pwm_init(uint, pwm_config *, bool){}
+void pwm_set_irq_enabled(uint, bool){}
+void pwm_set_both_levels(uint, uint16_t, uint16_t){}
+void pwm_set_counter(uint, uint16_t){}
+void pwm_set_enabled(uint, bool){}
+void pwm_set_mask_enabled(uint32_t mask){ pwm_hw->en = mask; }
+uint pwm_gpio_to_slice_num(uint gpio){ return (gpio >> 1) & 7; }
+
+static interp_hw_t interpRegs[2];
+interp_hw_t *interp0 = &interpRegs[0];
+interp_hw_t *interp1 = &interpRegs[1];
+
+interp_config interp_default_config(){ return interp_config{}; }
+void interp_config_set_clamp(interp_config *c, bool clamp){ c->clamp = clamp; }
+void interp_config_set_signed(interp_config *c, bool is_signed){ c->is_signed = is_signed; }
+void interp_set_config(interp_hw_t *, uint, interp_config *){}
+
+//////////
+// DMA: one thread per running channel
+
+#define NUM_DMA_CHANNELS 12
+
+struct HostDMAChannel {
+	bool claimed = false;
+	dma_channel_config cfg{};
+	volatile void *write = nullptr;
+	const volatile void *read = nullptr;
+	uint count = 0;
+	std::thread worker;
+	std::atomic<bool> busy{false};
+	std::atomic<bool> abort{false};
+};
+
+static HostDMAChannel channels[NUM_DMA_CHANNELS];
+static dma_hw_t dmaRegs;
+dma_hw_t *dma_hw = &dmaRegs;
+
+static void dmaJoin(HostDMAChannel &ch){
+	if (ch.worker.joinable())
+		ch.worker.join();
+}
+
+static void dmaRun(HostDMAChannel &ch){
+	dmaJoin(ch);
+	if (ch.cfg.dreq != DREQ_FORCE) { // paced by a timer or peripheral we don't have
+		ch.busy = true;
+		return;
+	}
+
+	ch.abort = false;
+	ch.busy = true;
+	ch.worker = std::thread([&ch]{
+		size_t size = 1 << ch.cfg.size;
+		auto *w = (volatile uint8_t *)ch.write;
+		auto *r = (const volatile uint8_t *)ch.read;
+		for (uint i = 0; i < ch.count && ! ch.abort; i++) {
+			for (size_t b = 0; b < size; b++)
+				w[b] = r[b];
+			if (ch.cfg.readIncr)
+				r += size;
+			if (ch.cfg.writeIncr)
+				w += size;
+			if ((i & 63) == 63) // let the CPU get a word in
+				std::this_thread::yield();
+		}
+		ch.busy = false;
+	});
+}
+
+int dma_claim_unused_channel(bool required){
+	for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+		if (! channels[i].claimed) {
+			channels[i].claimed = true;
+			return i;
+		}
+	}
+	if (required)
+		abort();
+	return -1;
+}
+
+void dma_channel_unclaim(uint channel){
+	dma_channel_abort(channel);
+	channels[channel].claimed = false;
+}
+
+int dma_claim_unused_timer(bool){ return 0; }
+void dma_timer_set_fraction(uint, uint16_t, uint16_t){}
+uint dma_get_timer_dreq(uint timer){ return 0x3b + timer; }
+
+dma_channel_config dma_channel_get_default_config(uint channel){
+	dma_channel_config c{};
+	c.size = DMA_SIZE_32;
+	c.readIncr = true;
+	c.writeIncr = false;
+	c.dreq = DREQ_FORCE;
+	c.chainTo = channel;
+	return c;
+}
+void channel_config_set_read_increment(dma_channel_config *c, bool incr){ c->readIncr = incr; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incr){ c->writeIncr = incr; }
+void channel_config_set_transfer_data_size(dma_channel_config *c, dma_channel_transfer_size size){ c->size = size; }
+void channel_config_set_dreq(dma_channel_config *c, uint dreq){ c->dreq = dreq; }
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to){ c->chainTo = chain_to; }
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+		const volatile void *read_addr, uint transfer_count, bool trigger){
+	HostDMAChannel &ch = channels[channel];
+	dma_channel_abort(channel);
+	ch.cfg = *config;
+	ch.write = write_addr;
+	ch.read = read_addr;
+	ch.count = transfer_count;
+	if (trigger)
+		dmaRun(ch);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger){
+	channels[channel].read = read_addr;
+	if (trigger)
+		dmaRun(channels[channel]);
+}
+
+void dma_channel_start(uint channel){ dmaRun(channels[channel]); }
+
+void dma_start_channel_mask(uint32_t mask){
+	for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+		if (mask & (1u << i))
+			dma_channel_start(i);
+}
+
+bool dma_channel_is_busy(uint channel){ return channels[channel].busy; }
+
+void dma_channel_abort(uint channel){
+	HostDMAChannel &ch = channels[channel];
+	ch.abort = true;
+	dmaJoin(ch);
+	ch.busy = false;
+}
+
+void dma_channel_set_irq0_enabled(uint, bool){}
+void dma_channel_set_irq1_enabled(uint, bool){}
+void dma_channel_acknowledge_irq0(uint channel){ dma_hw->ints0 &= ~(1u << channel); }
+void dma_channel_acknowledge_irq1(uint channel){ dma_hw->ints1 &= ~(1u << channel); }
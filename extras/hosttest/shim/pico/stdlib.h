@@ -0,0 +1,6 @@
+// Host shim for the pico-sdk.
+#pragma once
+
+#include "Arduino.h"
+
+uint32_t time_us_32();
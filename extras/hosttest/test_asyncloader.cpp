@@ -0,0 +1,163 @@
+// AsyncLoader tests: chunked loads from memory (with a thread standing in for the DMA channel)
+// & from Streams, progress, completion, "play when N frames are ready", truncation & cancel.
+
+#include "AsyncLoader.h"
+#include "check.h"
+
+#include <unistd.h>
+#include <vector>
+
+// A Stream over some 16-bit samples, which runs dry at the end.
+class SampleStream : public Stream {
+public:
+	SampleStream(const std::vector<int16_t> &s) : samples(s) {}
+	int available() override { return (samples.size() * 2) - pos; }
+	int read() override { return available() > 0 ? ((const uint8_t *)samples.data())[pos++] : -1; }
+private:
+	std::vector<int16_t> samples;
+	size_t pos = 0;
+};
+
+static std::vector<int16_t> ramp(uint32_t n){
+	std::vector<int16_t> s(n);
+	for (uint32_t i = 0; i < n; i++)
+		s[i] = (int16_t)(i * 8);
+	return s;
+}
+
+static bool scaled(AudioBuffer *b, const std::vector<int16_t> &src, uint32_t n){
+	for (uint32_t i = 0; i < n; i++) {
+		if (b->data[i] != (src[i] >> (16 - WAV_PWM_BITS)))
+			return false;
+	}
+	return true;
+}
+
+static void testMemory(){
+	const uint32_t n = 5 * ASYNCLOADER_CHUNK + 100;
+	std::vector<int16_t> src = ramp(n);
+	AudioTrack track(1, n);
+	AsyncLoader loader;
+	int completions = 0;
+	uint32_t readyAtPlay = 0;
+	loader.onComplete([&](AsyncLoader &){ completions++; });
+
+	CHECK(loader.load(&track, src.data(), n, 2 * ASYNCLOADER_CHUNK));
+	CHECK(loader.busy());
+	CHECK_EQ(loader.framesTotal(), n);
+
+	int steps = 0;
+	while (loader.update()) {
+		if (track.playing && readyAtPlay == 0)
+			readyAtPlay = loader.framesReady();
+		CHECK(track.playbackLen == loader.framesReady());
+		steps++;
+	}
+
+	CHECK(steps > 0);
+	CHECK(! loader.busy());
+	CHECK_EQ(completions, 1);
+	CHECK_EQ(loader.framesReady(), n);
+	CHECK(loader.progress() == 1.0);
+	CHECK(track.playing);
+	CHECK(readyAtPlay >= 2 * ASYNCLOADER_CHUNK && readyAtPlay < n);
+	CHECK_EQ(track.playbackLen, n);
+	CHECK_EQ(track.buf->sampleLen, n);
+	CHECK(scaled(track.buf, src, n));
+}
+
+static void testStereoFrames(){
+	const uint32_t frames = 1500;
+	std::vector<int16_t> src = ramp(2 * frames);
+	AudioBuffer buf(2, frames);
+	AsyncLoader loader;
+
+	CHECK(loader.load(&buf, src.data(), 2 * frames));
+	CHECK_EQ(loader.framesTotal(), frames);
+	while (loader.update())
+		CHECK(loader.framesReady() <= frames);
+	CHECK_EQ(loader.framesReady(), frames);
+	CHECK_EQ(buf.sampleLen, frames);
+	CHECK(scaled(&buf, src, 2 * frames));
+}
+
+static void testStream(){
+	const uint32_t n = 3 * ASYNCLOADER_CHUNK;
+	std::vector<int16_t> src = ramp(n);
+	SampleStream stream(src);
+	AudioTrack track(1, n);
+	AsyncLoader loader;
+
+	CHECK(loader.load(&track, stream, n, ASYNCLOADER_CHUNK + 1));
+	CHECK(loader.update());
+	CHECK(! track.playing);	// not enough yet
+	CHECK(loader.update());
+	CHECK(track.playing);
+	CHECK(! loader.update());
+	CHECK_EQ(loader.framesReady(), n);
+	CHECK(scaled(track.buf, src, n));
+}
+
+// A stream that ends before playAfter frames arrive still plays what it had:
+static void testTruncatedStream(){
+	const uint32_t n = 300;
+	std::vector<int16_t> src = ramp(n);
+	SampleStream stream(src);
+	AudioTrack track(1, 4 * ASYNCLOADER_CHUNK);
+	AsyncLoader loader;
+	int completions = 0;
+	uint32_t totalAtCompletion = 0;
+	loader.onComplete([&](AsyncLoader &l){
+		completions++;
+		totalAtCompletion = l.framesTotal();
+	});
+
+	CHECK(loader.load(&track, stream, 4 * ASYNCLOADER_CHUNK, 2 * ASYNCLOADER_CHUNK));
+	while (loader.update())
+		;
+	CHECK_EQ(completions, 1);
+	CHECK_EQ(totalAtCompletion, n);
+	CHECK_EQ(loader.framesReady(), n);
+	CHECK(track.playing);
+	CHECK_EQ(track.playbackLen, n);
+
+	// & an empty one doesn't play at all:
+	SampleStream empty(std::vector<int16_t>{});
+	AudioTrack silent(1, 100);
+	CHECK(loader.load(&silent, empty, 100, 10));
+	while (loader.update())
+		;
+	CHECK(! silent.playing);
+	CHECK_EQ(completions, 2);
+}
+
+static void testCancel(){
+	const uint32_t n = 64 * ASYNCLOADER_CHUNK;
+	std::vector<int16_t> src = ramp(n);
+	AudioBuffer buf(1, n);
+	AsyncLoader loader;
+
+	CHECK(loader.load(&buf, src.data(), n));
+	CHECK(! loader.load(&buf, src.data(), n));	// one at a time
+	loader.update();
+	loader.cancel();
+	CHECK(! loader.busy());
+	CHECK(! loader.update());
+	CHECK(buf.sampleLen < n);
+
+	// & it's ready for another:
+	CHECK(loader.load(&buf, src.data(), n));
+	while (loader.update())
+		;
+	CHECK(scaled(&buf, src, n));
+}
+
+int main(){
+	alarm(10);
+	testMemory();
+	testStereoFrames();
+	testStream();
+	testTruncatedStream();
+	testCancel();
+	return checkResult("test_asyncloader");
+}
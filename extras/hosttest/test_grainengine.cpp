@@ -0,0 +1,54 @@
+// GrainEngine tests: grains last exactly as long as asked, & free themselves.
+
+#include "GrainEngine.h"
+#include "check.h"
+
+#include <unistd.h>
+
+// How many frames does one grain of this length add to the mix?
+static int framesRendered(GrainEngine &grains, uint32_t length, GrainEngine::window_t window){
+	int32_t mix[64];
+	int frames = 0;
+
+	CHECK(grains.trigger(0, length, 1.0, 1.0, window) >= 0);
+	for (int block = 0; block < 1000 && ! grains.idle(); block++) {
+		memset(mix, 0, sizeof(mix));
+		grains.render(mix, 64, WAV_PWM_BITS);
+		for (int i = 0; i < 64; i++)
+			if (mix[i] != 0)
+				frames = block * 64 + i + 1;
+	}
+	CHECK(grains.idle());
+	CHECK_EQ(grains.active(), 0);
+	return frames;
+}
+
+static void testLength(){
+	AudioBuffer buf(1, 1000);
+	for (int i = 0; i < 1000; i++)
+		buf.data[i] = 100;
+	GrainEngine grains(buf);
+
+	const uint32_t lengths[] = { 1, 3, 40, 64, 65, 100, 255, 256, 257, 1000, 4410 };
+	for (uint32_t len : lengths) {
+		int got = framesRendered(grains, len, GrainEngine::WINDOW_RECT);
+		if (got != (int)len) {
+			printf("grain of %u frames rendered %d\n", len, got);
+			checksFailed++;
+		}
+	}
+}
+
+static void testRefused(){
+	AudioBuffer stereo(2, 100);
+	GrainEngine grains(stereo);
+	CHECK_EQ(grains.trigger(0, 10), -1);
+	CHECK(grains.idle());
+}
+
+int main(){
+	alarm(10);
+	testLength();
+	testRefused();
+	return checkResult("test_grainengine");
+}
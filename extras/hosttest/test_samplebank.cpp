@@ -0,0 +1,140 @@
+// SampleBank tests: loading & mapping banks, name lookup, loop points,
+// and refusing damaged banks rather than reading outside them.
+
+#include "SampleBank.h"
+#include "check.h"
+
+#include <unistd.h>
+#include <vector>
+
+// A little bank, laid out the way mkbank does it: header, index, hash table, payloads.
+struct TestBank {
+	std::vector<uint32_t> words;	// (word-aligned, like map() wants)
+
+	SampleBankHeader *header() { return (SampleBankHeader *)words.data(); }
+	SampleBankEntry *entry(int i) { return (SampleBankEntry *)((uint8_t *)words.data() + header()->indexOffset) + i; }
+	uint16_t *hash() { return (uint16_t *)((uint8_t *)words.data() + header()->hashOffset); }
+	uint32_t bytes() { return words.size() * 4; }
+
+	TestBank(std::vector<const char *> names, uint32_t frames, uint8_t bits = WAV_PWM_BITS){
+		auto align = [](uint32_t x){ return (x + SAMPLEBANK_ALIGN - 1) & ~(SAMPLEBANK_ALIGN - 1); };
+		uint16_t count = names.size();
+		uint16_t slots = 2;
+		while (slots < 2 * count)
+			slots *= 2;
+
+		uint32_t indexOffset = align(sizeof(SampleBankHeader));
+		uint32_t hashOffset = align(indexOffset + count * sizeof(SampleBankEntry));
+		uint32_t dataOffset = align(hashOffset + slots * sizeof(uint16_t));
+		uint32_t payload = align(frames * BYTES_PER_SAMPLE);
+		uint32_t fileSize = dataOffset + count * payload;
+		words.assign(fileSize / 4, 0);
+
+		SampleBankHeader *h = header();
+		h->magic = SAMPLEBANK_MAGIC;
+		h->version = SAMPLEBANK_VERSION;
+		h->count = count;
+		h->bits = bits;
+		h->hashSlots = slots;
+		h->indexOffset = indexOffset;
+		h->hashOffset = hashOffset;
+		h->dataOffset = dataOffset;
+		h->fileSize = fileSize;
+
+		for (int i = 0; i < count; i++) {
+			SampleBankEntry *e = entry(i);
+			strncpy(e->name, names[i], SAMPLEBANK_NAME_LEN - 1);
+			e->offset = dataOffset + i * payload;
+			e->frames = frames;
+			e->channels = 1;
+			e->rootNote = 60 * 256;
+			int16_t *d = (int16_t *)((uint8_t *)words.data() + e->offset);
+			for (uint32_t f = 0; f < frames; f++)
+				d[f] = (int16_t)(i * 1000 + f);
+
+			uint32_t slot = sampleBankHash(names[i]) & (slots - 1);
+			while (hash()[slot])
+				slot = (slot + 1) & (slots - 1);
+			hash()[slot] = i + 1;
+		}
+	}
+};
+
+static void testLookup(){
+	TestBank tb({ "kick", "snare", "pad" }, 100);
+	tb.entry(2)->flags = SAMPLEBANK_FLAG_LOOP;
+	tb.entry(2)->loopStart = 20;
+	tb.entry(2)->loopLen = 30;
+
+	SampleBank bank;
+	CHECK(bank.map(tb.words.data(), tb.bytes()));
+	CHECK_EQ(bank.count(), 3);
+	CHECK_EQ(bank.find("kick"), 0);
+	CHECK_EQ(bank.find("pad"), 2);
+	CHECK_EQ(bank.find("nope"), -1);
+	CHECK_EQ(bank.buffer(1)->data[5], 1005);	// played in place
+	CHECK(bank.speedFor(0, 72) == 2.0);
+
+	// the head plays, then the loop:
+	AudioTrack *t = bank.newTrack(2);
+	CHECK(t != NULL);
+	CHECK_EQ(t->playbackStart, 0);
+	CHECK_EQ(t->playbackLen, 100);
+	CHECK_EQ(t->loopStart, 20);
+	CHECK_EQ(t->loopLen, 30);
+	delete t;
+}
+
+static void testLoad(){
+	TestBank tb({ "ramp" }, 64, 16);
+	fs::FS fs;
+	fs.put("/b.bnk", std::vector<uint8_t>((uint8_t *)tb.words.data(), (uint8_t *)tb.words.data() + tb.bytes()));
+
+	SampleBank bank;
+	CHECK(bank.load(fs, "/b.bnk"));
+	CHECK_EQ(bank.buffer(0)->data[63], 63 >> (16 - WAV_PWM_BITS));	// scaled to our bits
+	CHECK(! bank.load(fs, "/nope.bnk"));
+
+	// but a 16-bit bank can't be scaled in place:
+	CHECK(! bank.map(tb.words.data(), tb.bytes()));
+}
+
+// Each of these damages a good bank; none may open, or read outside it.
+static void testDamaged(){
+	struct Damage { const char *what; void (*apply)(TestBank &); };
+	Damage damage[] = {
+		{ "bad magic",					[](TestBank &b){ b.header()->magic ^= 1; } },
+		{ "file size > image",	[](TestBank &b){ b.header()->fileSize += 4; } },
+		{ "index past the end",	[](TestBank &b){ b.header()->indexOffset = b.header()->fileSize - 4; } },
+		{ "index wraps",				[](TestBank &b){ b.header()->indexOffset = 0xFFFFFFF0; } },
+		{ "hash wraps",					[](TestBank &b){ b.header()->hashOffset = 0xFFFFFFF0; } },
+		{ "hash slots not 2^n",	[](TestBank &b){ b.header()->hashSlots = 7; } },
+		{ "hash slot > count",	[](TestBank &b){ b.hash()[1] = b.header()->count + 1; } },
+		{ "frames wrap",				[](TestBank &b){ b.entry(1)->frames = 0x80000000; } },
+		{ "payload past end",		[](TestBank &b){ b.entry(2)->frames += 100; } },
+		{ "offset wraps",				[](TestBank &b){ b.entry(0)->offset = 0xFFFFFFFC; } },
+		{ "no channels",				[](TestBank &b){ b.entry(0)->channels = 0; } },
+		{ "loop past end",			[](TestBank &b){ b.entry(0)->flags = SAMPLEBANK_FLAG_LOOP; b.entry(0)->loopStart = 90; b.entry(0)->loopLen = 11; } },
+		{ "loop wraps",					[](TestBank &b){ b.entry(0)->flags = SAMPLEBANK_FLAG_LOOP; b.entry(0)->loopStart = 10; b.entry(0)->loopLen = 0xFFFFFFFF; } },
+	};
+
+	for (auto &d : damage) {
+		TestBank tb({ "kick", "snare", "pad" }, 100);
+		d.apply(tb);
+		SampleBank bank;
+		if (bank.map(tb.words.data(), tb.bytes())) {
+			printf("damaged bank opened: %s\n", d.what);
+			checksFailed++;
+		}
+		CHECK_EQ(bank.count(), 0);
+		CHECK_EQ(bank.find("kick"), -1);
+	}
+}
+
+int main(){
+	alarm(10);
+	testLookup();
+	testLoad();
+	testDamaged();
+	return checkResult("test_samplebank");
+}
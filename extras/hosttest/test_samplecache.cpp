@@ -0,0 +1,147 @@
+// SampleCache tests: sharing, reference counts, LRU eviction, the budget & prefetch,
+// loading from an in-memory fs::FS.
+
+#include "SampleCache.h"
+#include "check.h"
+
+#include <unistd.h>
+
+// n mono 16-bit samples, all the same value
+static std::vector<uint8_t> rawFile(uint32_t n, int16_t value){
+	std::vector<uint8_t> bytes(n * 2);
+	for (uint32_t i = 0; i < n; i++) {
+		bytes[2 * i] = value & 0xFF;
+		bytes[2 * i + 1] = (value >> 8) & 0xFF;
+	}
+	return bytes;
+}
+
+static void testSharing(){
+	fs::FS fs;
+	fs.put("/a.raw", rawFile(100, 0x4000));
+	SampleCache cache(fs, 10000);
+
+	AudioBuffer *a1 = cache.acquire("/a.raw");
+	AudioBuffer *a2 = cache.acquire("/a.raw");
+	CHECK(a1 != NULL);
+	CHECK(a1 == a2);
+	CHECK_EQ(fs.opens, 1);
+	CHECK_EQ(cache.hits, 1);
+	CHECK_EQ(cache.misses, 1);
+	CHECK_EQ(cache.bytesUsed(), 200);
+	CHECK_EQ(a1->sampleLen, 100);
+	CHECK_EQ(a1->data[50], 0x4000 >> (16 - WAV_PWM_BITS));
+
+	CHECK(cache.acquire("/nope.raw") == NULL);
+
+	// still referenced, so flush() leaves it alone:
+	cache.release(a1);
+	cache.flush();
+	CHECK_EQ(cache.bytesUsed(), 200);
+	cache.release(a2);
+	cache.flush();
+	CHECK_EQ(cache.bytesUsed(), 0);
+	CHECK_EQ(cache.evictions, 1);
+}
+
+static void testEviction(){
+	fs::FS fs;
+	fs.put("/a.raw", rawFile(100, 1));
+	fs.put("/b.raw", rawFile(100, 2));
+	fs.put("/c.raw", rawFile(100, 3));
+	SampleCache cache(fs, 400); // room for two
+
+	AudioBuffer *a = cache.acquire("/a.raw");
+	AudioBuffer *b = cache.acquire("/b.raw");
+	cache.release(a);
+	cache.release(b);
+	a = cache.acquire("/a.raw"); // now b is the least recently used
+	cache.release(a);
+
+	AudioBuffer *c = cache.acquire("/c.raw");
+	CHECK(c != NULL);
+	CHECK_EQ(cache.evictions, 1);
+	CHECK_EQ(cache.bytesUsed(), 400);
+
+	unsigned long opens = fs.opens;
+	cache.release(cache.acquire("/a.raw"));
+	CHECK_EQ(fs.opens, opens);			// a stayed
+	cache.release(cache.acquire("/b.raw"));
+	CHECK_EQ(fs.opens, opens + 1);	// b had to be reloaded (evicting a)
+
+	// c is in use, and a & b can't both fit beside it:
+	AudioBuffer *a2 = cache.acquire("/a.raw");
+	CHECK(a2 != NULL);
+	CHECK(cache.acquire("/b.raw") == NULL);
+	CHECK_EQ(cache.bytesUsed(), 400);
+
+	// too big for the whole budget:
+	fs.put("/big.raw", rawFile(300, 0));
+	CHECK(cache.acquire("/big.raw") == NULL);
+
+	cache.release(a2);
+	cache.release(c);
+}
+
+static void testPrefetchAndBudget(){
+	fs::FS fs;
+	fs.put("/a.raw", rawFile(100, 1));
+	fs.put("/b.raw", rawFile(100, 2));
+	SampleCache cache(fs, 1000);
+
+	CHECK(cache.prefetch("/a.raw"));
+	CHECK(cache.prefetch("/b.raw"));
+	CHECK(! cache.prefetch("/nope.raw"));
+	CHECK_EQ(fs.opens, 3);
+
+	AudioBuffer *a = cache.acquire("/a.raw");
+	CHECK(a != NULL);
+	CHECK_EQ(fs.opens, 3);
+	CHECK_EQ(cache.hits, 1);
+
+	// shrinking evicts what's unreferenced, right away:
+	cache.setBudget(200);
+	CHECK_EQ(cache.bytesUsed(), 200);
+	CHECK_EQ(cache.evictions, 1);
+
+	// & referenced samples stay put, even over budget:
+	cache.setBudget(0);
+	CHECK_EQ(cache.bytesUsed(), 200);
+	cache.release(a);
+	cache.setBudget(0);
+	CHECK_EQ(cache.bytesUsed(), 0);
+}
+
+static void testMixerTracks(){
+	fs::FS fs;
+	fs.put("/a.raw", rawFile(100, 1));
+	SampleCache cache(fs, 1000);
+	Mixer<10, 4, 40, 2> mixer;
+	mixer.init(2);
+	mixer.start();
+
+	AudioTrack *t1 = mixer.addTrack(cache, "/a.raw");
+	AudioTrack *t2 = mixer.addTrack(cache, "/a.raw");
+	CHECK(t1 != NULL && t2 != NULL);
+	CHECK(t1->buf == t2->buf);
+	CHECK_EQ(fs.opens, 1);
+
+	// freeing tracks gives their references back, even with the ISR switched off
+	// while the DMA is still running:
+	mixer.enableISR(false);
+	mixer.freeTrack(t1);
+	mixer.freeTrack(t2);
+	cache.flush();
+	CHECK_EQ(cache.bytesUsed(), 0);
+
+	mixer.stop();
+}
+
+int main(){
+	alarm(10); // (a wait that never ends is a failure too)
+	testSharing();
+	testEviction();
+	testPrefetchAndBudget();
+	testMixerTracks();
+	return checkResult("test_samplecache");
+}
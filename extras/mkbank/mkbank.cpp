@@ -0,0 +1,229 @@
+// mkbank -- packs raw sample files into a Picomix sample bank
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+//
+// This runs on your computer, not the RP2040.  Build it with any C++17 compiler:
+//
+//     c++ -std=c++17 -O2 -I../../src -o mkbank mkbank.cpp
+//
+// Usage:
+//
+//     mkbank [-b bits] [-H bank.h] -o bank.bnk sample.raw[,option...] ...
+//
+// Each input is a raw file of signed 16-bit little-endian samples, like Picomix
+// already loads (sox foo.wav -b 16 -e signed foo.raw).  Options, separated by commas:
+//
+//     name=NAME         lookup name (default: file name without directory or extension)
+//     loop=START:LEN    loop points, in frames
+//     root=NOTE         MIDI note the sample plays at speed 1.0 (may be fractional; default 60)
+//     channels=N        interleaved channels (default 1)
+//
+// -b sets the bit depth to pre-scale samples to; it should match WAV_PWM_BITS (default 10).
+// -H also writes the bank as a C array, which you can compile into a sketch & map() in place.
+
+#include "SampleBankFormat.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct Input {
+	std::string path;
+	SampleBankEntry entry;
+	std::vector<int16_t> samples;
+};
+
+static void usage(){
+	fprintf(stderr, "usage: mkbank [-b bits] [-H bank.h] -o bank.bnk sample.raw[,name=N][,loop=START:LEN][,root=NOTE][,channels=N] ...\n");
+	exit(1);
+}
+
+static void fail(const std::string &msg){
+	fprintf(stderr, "mkbank: %s\n", msg.c_str());
+	exit(1);
+}
+
+static std::string baseName(const std::string &path){
+	size_t slash = path.find_last_of("/\\");
+	std::string b = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = b.find_last_of('.');
+	return (dot == std::string::npos) ? b : b.substr(0, dot);
+}
+
+static Input parseInput(const std::string &arg, int bits){
+	Input in;
+	memset(&in.entry, 0, sizeof(in.entry));
+	in.entry.channels = 1;
+	in.entry.rootNote = 60 * 256;
+
+	size_t comma = arg.find(',');
+	in.path = arg.substr(0, comma);
+	std::string name = baseName(in.path);
+
+	while (comma != std::string::npos) {
+		size_t next = arg.find(',', comma + 1);
+		std::string opt = arg.substr(comma + 1, next == std::string::npos ? std::string::npos : next - comma - 1);
+		comma = next;
+
+		size_t eq = opt.find('=');
+		if (eq == std::string::npos)
+			fail("bad option '" + opt + "'");
+		std::string key = opt.substr(0, eq), val = opt.substr(eq + 1);
+
+		if (key == "name") {
+			name = val;
+		} else if (key == "loop") {
+			unsigned long start, len;
+			if (sscanf(val.c_str(), "%lu:%lu", &start, &len) != 2 || len == 0)
+				fail("bad loop '" + val + "' (want START:LEN)");
+			in.entry.loopStart = start;
+			in.entry.loopLen = len;
+			in.entry.flags |= SAMPLEBANK_FLAG_LOOP;
+		} else if (key == "root") {
+			in.entry.rootNote = (uint16_t)lround(atof(val.c_str()) * 256);
+		} else if (key == "channels") {
+			int c = atoi(val.c_str());
+			if (c < 1 || c > 255)
+				fail("bad channels '" + val + "'");
+			in.entry.channels = c;
+		} else {
+			fail("unknown option '" + key + "'");
+		}
+	}
+
+	if (name.empty() || name.size() >= SAMPLEBANK_NAME_LEN)
+		fail("sample name '" + name + "' must be 1 to " + std::to_string(SAMPLEBANK_NAME_LEN - 1) + " characters");
+	strncpy(in.entry.name, name.c_str(), SAMPLEBANK_NAME_LEN - 1);
+
+	std::ifstream f(in.path, std::ios::binary);
+	if (! f)
+		fail("can't read " + in.path);
+	std::vector<uint8_t> raw((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+	size_t count = raw.size() / 2;
+	in.samples.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		int16_t s = (int16_t)(raw[2 * i] | (raw[2 * i + 1] << 8));
+		in.samples[i] = s >> (16 - bits); // same scaling Picomix does when it loads a raw file
+	}
+
+	in.entry.frames = count / in.entry.channels;
+	if ((in.entry.flags & SAMPLEBANK_FLAG_LOOP) && (in.entry.loopStart >= in.entry.frames || in.entry.loopLen > in.entry.frames - in.entry.loopStart))
+		fail(name + ": loop runs past the end of the sample");
+	return in;
+}
+
+static void put(std::vector<uint8_t> &out, size_t at, const void *p, size_t len){
+	memcpy(&out[at], p, len);
+}
+
+static size_t align(size_t n){
+	return (n + SAMPLEBANK_ALIGN - 1) & ~(size_t)(SAMPLEBANK_ALIGN - 1);
+}
+
+int main(int argc, char **argv){
+	int bits = 10;
+	std::string outPath, headerPath;
+	std::vector<std::string> args;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		if (a == "-b" && i + 1 < argc)
+			bits = atoi(argv[++i]);
+		else if (a == "-o" && i + 1 < argc)
+			outPath = argv[++i];
+		else if (a == "-H" && i + 1 < argc)
+			headerPath = argv[++i];
+		else if (a[0] == '-')
+			usage();
+		else
+			args.push_back(a);
+	}
+	if (outPath.empty() || args.empty())
+		usage();
+	if (bits < 8 || bits > 16)
+		fail("bits must be between 8 and 16");
+	// the hash table (below) needs twice as many slots, & its size has to fit in 16 bits
+	if (args.size() > 0x8000 / 2)
+		fail("too many samples (16384 at most)");
+
+	std::vector<Input> inputs;
+	for (auto &a : args)
+		inputs.push_back(parseInput(a, bits));
+
+	// the hash table is at least twice as big as the index, so probes stay short
+	uint16_t slots = 2;
+	while (slots < 2 * inputs.size())
+		slots *= 2;
+
+	SampleBankHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = SAMPLEBANK_MAGIC;
+	h.version = SAMPLEBANK_VERSION;
+	h.count = inputs.size();
+	h.bits = bits;
+	h.hashSlots = slots;
+	h.indexOffset = sizeof(SampleBankHeader);
+	h.hashOffset = h.indexOffset + inputs.size() * sizeof(SampleBankEntry);
+	h.dataOffset = align(h.hashOffset + slots * sizeof(uint16_t));
+
+	size_t at = h.dataOffset;
+	for (auto &in : inputs) {
+		in.entry.offset = at;
+		at = align(at + in.samples.size() * sizeof(int16_t));
+	}
+	h.fileSize = at;
+
+	std::vector<uint16_t> table(slots, 0);
+	for (size_t i = 0; i < inputs.size(); i++) {
+		uint32_t slot = sampleBankHash(inputs[i].entry.name) & (slots - 1);
+		while (table[slot] != 0) {
+			if (strcmp(inputs[table[slot] - 1].entry.name, inputs[i].entry.name) == 0)
+				fail(std::string("duplicate sample name '") + inputs[i].entry.name + "'");
+			slot = (slot + 1) & (slots - 1);
+		}
+		table[slot] = i + 1;
+	}
+
+	// (this assumes a little-endian host, like the RP2040)
+	std::vector<uint8_t> out(h.fileSize, 0);
+	put(out, 0, &h, sizeof(h));
+	for (size_t i = 0; i < inputs.size(); i++) {
+		put(out, h.indexOffset + i * sizeof(SampleBankEntry), &inputs[i].entry, sizeof(SampleBankEntry));
+		put(out, inputs[i].entry.offset, inputs[i].samples.data(), inputs[i].samples.size() * sizeof(int16_t));
+	}
+	put(out, h.hashOffset, table.data(), slots * sizeof(uint16_t));
+
+	std::ofstream o(outPath, std::ios::binary);
+	o.write((const char *)out.data(), out.size());
+	if (! o)
+		fail("can't write " + outPath);
+
+	if (! headerPath.empty()) {
+		std::string var = baseName(headerPath);
+		for (auto &c : var)
+			if (! isalnum((unsigned char)c))
+				c = '_';
+
+		std::ofstream hf(headerPath);
+		hf << "// Picomix sample bank, made by mkbank.  Use it with SampleBank::map(" << var << ", sizeof(" << var << ")).\n";
+		hf << "#include <stdint.h>\n\n";
+		hf << "const uint8_t " << var << "[" << out.size() << "] __attribute__((aligned(" << SAMPLEBANK_ALIGN << "))) = {";
+		for (size_t i = 0; i < out.size(); i++) {
+			if (i % 16 == 0)
+				hf << "\n\t";
+			hf << (int)out[i] << ",";
+		}
+		hf << "\n};\n";
+		if (! hf)
+			fail("can't write " + headerPath);
+	}
+
+	printf("%s: %zu samples, %u bytes\n", outPath.c_str(), inputs.size(), h.fileSize);
+	return 0;
+}
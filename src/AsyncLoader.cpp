@@ -0,0 +1,193 @@
+// AsyncLoader -- background sample loading for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "AsyncLoader.h"
+#include "hardware/dma.h"
+
+AsyncLoader::~AsyncLoader(){
+	cancel();
+	if (dmaCh >= 0)
+		dma_channel_unclaim(dmaCh);
+}
+
+// Common setup for every kind of load.
+bool AsyncLoader::begin(AudioBuffer *dst, uint32_t samples, uint8_t srcBits){
+	if (active) {
+		Dbg_println("loader busy");
+		return false;
+	}
+	if (dst == NULL || srcBits < WAV_PWM_BITS || srcBits > 16)
+		return false;
+
+	buf = dst;
+	total = min(samples, (uint32_t)(dst->channels * dst->samples));
+	ready = 0;
+	next = 0;
+	nextLen = 0;
+	shift = srcBits - WAV_PWM_BITS;
+	started = false;
+	dmaBusy = false;
+
+	// nothing's playable until it's loaded:
+	buf->sampleStart = 0;
+	buf->sampleLen = 0;
+	active = true;
+	return true;
+}
+
+bool AsyncLoader::load(AudioBuffer *dst, const int16_t *src, uint32_t samples, uint8_t srcBits){
+	if (! begin(dst, samples, srcBits))
+		return false;
+	srcMem = src;
+	srcStream = NULL;
+
+	// get a DMA channel, the same way PWMStreamer does:
+	if (dmaCh < 0)
+		dmaCh = dma_claim_unused_channel(true);
+
+	startDMA();
+	return true;
+}
+
+bool AsyncLoader::load(AudioBuffer *dst, Stream &src, uint32_t samples, uint8_t srcBits){
+	if (! begin(dst, samples, srcBits))
+		return false;
+	srcMem = NULL;
+	srcStream = &src;
+	return true;
+}
+
+bool AsyncLoader::load(AudioTrack *t, const int16_t *src, uint32_t samples, uint32_t after, uint8_t srcBits){
+	if (t == NULL || active)
+		return false;
+	t->pause();
+	t->playbackStart = 0;
+	t->playbackLen = 0;
+	track = t;
+	playAfter = after;
+	if (! load(t->buf, src, samples, srcBits)) {
+		track = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool AsyncLoader::load(AudioTrack *t, Stream &src, uint32_t samples, uint32_t after, uint8_t srcBits){
+	if (t == NULL || active)
+		return false;
+	t->pause();
+	t->playbackStart = 0;
+	t->playbackLen = 0;
+	track = t;
+	playAfter = after;
+	if (! load(t->buf, src, samples, srcBits)) {
+		track = NULL;
+		return false;
+	}
+	return true;
+}
+
+// Copy the next chunk from memory into the buffer, in the background.
+void AsyncLoader::startDMA(){
+	next = ready;
+	nextLen = min((uint32_t)ASYNCLOADER_CHUNK, total - next);
+	if (nextLen == 0)
+		return;
+
+	const int16_t *from = srcMem + next;
+	int16_t *to = buf->data + next;
+	bool words = (((uintptr_t)from | (uintptr_t)to) & 3) == 0 && (nextLen & 1) == 0;
+
+	dma_channel_config cfg = dma_channel_get_default_config(dmaCh);
+	channel_config_set_read_increment(&cfg, true);
+	channel_config_set_write_increment(&cfg, true);
+	channel_config_set_transfer_data_size(&cfg, words ? DMA_SIZE_32 : DMA_SIZE_16);
+	channel_config_set_dreq(&cfg, DREQ_FORCE);	// as fast as it'll go
+	dma_channel_configure(dmaCh, &cfg, to, from, words ? nextLen / 2 : nextLen, true);
+	dmaBusy = true;
+}
+
+// Scale some freshly-loaded samples down to our bit depth.
+void AsyncLoader::convert(uint32_t from, uint32_t len){
+	if (shift == 0)
+		return;
+	int16_t *d = buf->data + from;
+	for (uint32_t i = 0; i < len; i++)
+		d[i] = d[i] >> shift;
+}
+
+// Make more of the buffer playable, & start the track if it's waiting for that.
+void AsyncLoader::publish(uint32_t samples){
+	ready = samples;
+	uint32_t frames = ready / buf->channels;
+	buf->sampleLen = frames;
+
+	if (track) {
+		track->playbackStart = 0;
+		track->playbackLen = frames;
+		if (! started && frames > 0 && (frames >= playAfter || ready == total)) {
+			track->play();
+			started = true;
+		}
+	}
+}
+
+void AsyncLoader::finish(){
+	active = false;
+	track = NULL;
+	srcMem = NULL;
+	srcStream = NULL;
+	if (completion)
+		completion(*this);
+}
+
+bool AsyncLoader::update(){
+	if (! active)
+		return false;
+
+	if (srcMem) {
+		if (dma_channel_is_busy(dmaCh))
+			return true;
+
+		// That chunk's landed.  Start the next one moving, then convert this one.
+		uint32_t doneFrom = next, doneLen = nextLen;
+		dmaBusy = false;
+		if (doneFrom + doneLen < total) {
+			ready = doneFrom + doneLen; // (so startDMA() picks up after it)
+			startDMA();
+		}
+		convert(doneFrom, doneLen);
+		publish(doneFrom + doneLen);
+
+	} else if (srcStream) {
+		uint32_t len = min((uint32_t)ASYNCLOADER_CHUNK, total - ready);
+		uint32_t got = srcStream->readBytes((char *)(buf->data + ready), len * BYTES_PER_SAMPLE) / BYTES_PER_SAMPLE;
+		convert(ready, got);
+		if (got < len) { // the stream ran dry; that's all there is
+			Dbg_println("sample truncated");
+			total = ready + got;
+		}
+		publish(ready + got);
+	}
+
+	if (ready >= total) {
+		finish();
+		return false;
+	}
+	return true;
+}
+
+// Stop loading.  Whatever's already loaded stays playable.
+void AsyncLoader::cancel(){
+	if (! active)
+		return;
+	if (dmaBusy) {
+		dma_channel_abort(dmaCh);
+		dmaBusy = false;
+	}
+	active = false;
+	track = NULL;
+	srcMem = NULL;
+	srcStream = NULL;
+}
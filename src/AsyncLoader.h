@@ -0,0 +1,88 @@
+#ifndef __ASYNCLOADER_H
+#define __ASYNCLOADER_H
+
+// AsyncLoader -- background sample loading for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include <functional>
+#include "Picomix.h"
+
+//////////////////////////
+// Tweakable:
+//
+// ASYNCLOADER_CHUNK: samples moved & converted per step.
+// Bigger chunks finish sooner; smaller ones keep each update() call shorter.
+#define ASYNCLOADER_CHUNK 1024
+//
+/////////////////////////
+
+
+////////////////
+// AsyncLoader: fills an AudioBuffer a chunk at a time, so the caller never waits for a whole sample.
+//
+// From memory (flash, or a staging buffer you filled), a spare DMA channel copies each chunk
+// while the CPU converts the previous one to our bit depth.  From a Stream, each chunk is read
+// straight into the buffer & converted in place.
+//
+// Call update() from loop() until it returns false.  Watch progress() or set onComplete().
+// If you give it a track, the track starts playing as soon as playAfter frames are ready;
+// until the load finishes, the track's playback length grows with each chunk,
+// so it ends (or loops) early, rather than playing garbage, if it ever catches up.
+//
+class AsyncLoader {
+public:
+	AsyncLoader() {};
+	~AsyncLoader();
+
+	AsyncLoader(AsyncLoader const&)     = delete;
+	void operator=(AsyncLoader const&)  = delete;
+
+	// srcBits is the resolution of the source samples: 16 for raw files,
+	// or WAV_PWM_BITS if they're already scaled (like a SampleBank's).
+	bool load(AudioBuffer *dst, const int16_t *src, uint32_t samples, uint8_t srcBits = 16);
+	bool load(AudioBuffer *dst, Stream &src, uint32_t samples, uint8_t srcBits = 16);
+
+	// Same, but into a track's buffer, starting it once playAfter frames are ready:
+	bool load(AudioTrack *t, const int16_t *src, uint32_t samples, uint32_t playAfter, uint8_t srcBits = 16);
+	bool load(AudioTrack *t, Stream &src, uint32_t samples, uint32_t playAfter, uint8_t srcBits = 16);
+
+	bool update();		// do the next step; false when there's nothing left to do
+	void cancel();
+
+	bool busy() { return active; };
+	uint32_t framesReady() { return buf ? ready / buf->channels : 0; };
+	uint32_t framesTotal() { return buf ? total / buf->channels : 0; };
+	float progress() { return total ? (float)ready / total : 1.0; };
+
+	void onComplete(std::function<void(AsyncLoader &)> cb) { completion = cb; };
+
+private:
+	int dmaCh = -1;						// claimed on first use
+	bool active = false;
+	bool dmaBusy = false;
+
+	AudioBuffer *buf = NULL;
+	AudioTrack *track = NULL;
+	uint32_t playAfter = 0;
+	bool started = false;
+
+	const int16_t *srcMem = NULL;
+	Stream *srcStream = NULL;
+	uint8_t shift = 0;
+
+	uint32_t total = 0;				// samples to load
+	uint32_t ready = 0;				// samples loaded & converted
+	uint32_t next = 0;				// first sample of the chunk in flight (or not yet started)
+	uint32_t nextLen = 0;
+
+	std::function<void(AsyncLoader &)> completion;
+
+	bool begin(AudioBuffer *dst, uint32_t samples, uint8_t srcBits);
+	void startDMA();
+	void convert(uint32_t from, uint32_t len);
+	void publish(uint32_t samples);
+	void finish();
+};
+
+#endif  // __ASYNCLOADER_H
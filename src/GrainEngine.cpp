@@ -0,0 +1,148 @@
+// GrainEngine -- granular/slice playback for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "GrainEngine.h"
+
+int16_t GrainEngine::windows[GrainEngine::WINDOW_SHAPES][GRAIN_WINDOW_SIZE];
+bool GrainEngine::windowsReady = false;
+
+GrainEngine::GrainEngine(AudioBuffer &b): buf(&b) {
+	makeWindows();
+}
+
+GrainEngine::GrainEngine(AudioBuffer *b): buf(b) {
+	makeWindows();
+}
+
+// Build the window tables, once.
+void GrainEngine::makeWindows(){
+	if (windowsReady)
+		return;
+
+	const float twoPI = 6.283185;
+	const int taper = GRAIN_WINDOW_SIZE / 4; // Tukey: cosine fade over the first & last quarter
+
+	for (int i = 0; i < GRAIN_WINDOW_SIZE; i++){
+		float x = (i + 0.5) / GRAIN_WINDOW_SIZE;
+
+		windows[WINDOW_HANN][i] = 32767 * (0.5 - 0.5 * cos(twoPI * x));
+		windows[WINDOW_TRIANGLE][i] = 32767 * (1.0 - fabs(2.0 * x - 1.0));
+
+		if (i < taper)
+			windows[WINDOW_TUKEY][i] = 32767 * (0.5 - 0.5 * cos(twoPI * (i + 0.5) / (2 * taper)));
+		else if (i >= GRAIN_WINDOW_SIZE - taper)
+			windows[WINDOW_TUKEY][i] = 32767 * (0.5 - 0.5 * cos(twoPI * (GRAIN_WINDOW_SIZE - i - 0.5) / (2 * taper)));
+		else
+			windows[WINDOW_TUKEY][i] = 32767;
+
+		windows[WINDOW_RECT][i] = 32767;
+	}
+	windowsReady = true;
+}
+
+int GrainEngine::trigger(uint32_t startSample, uint32_t length, float speed, float gainLevel, window_t window){
+	if (buf == NULL || length == 0 || window >= WINDOW_SHAPES)
+		return -1;
+	if (buf->channels != 1) {
+		Dbg_println("grains need a mono buffer");
+		return -1;
+	}
+	if (buf->samples >= (1L << (32 - GRAIN_POS_FBITS))) {
+		Dbg_println("grain buffer too long");
+		return -1;
+	}
+
+	for (int g = 0; g < GRAIN_MAX; g++){
+		if (state[g] != GRAIN_FREE)
+			continue;
+
+		shape[g] = window;
+		pos[g] = (startSample % buf->samples) << GRAIN_POS_FBITS;
+		inc[g] = speed * (1 << GRAIN_POS_FBITS);
+		phase[g] = 0;
+		// rounded up, so the window closes after exactly length frames (not one more)
+		phaseInc[g] = max((uint32_t)1, (uint32_t)((((uint64_t)GRAIN_WINDOW_SIZE << GRAIN_PHASE_FBITS) + length - 1) / length));
+		gain[g] = max(0, gainLevel * WAV_PWM_RANGE);
+
+		__sync_synchronize(); // all that, before the ISR sees it playing
+		state[g] = GRAIN_PLAYING;
+		return g;
+	}
+	return -1;
+}
+
+void GrainEngine::stop(int g){
+	if (g >= 0 && g < GRAIN_MAX && state[g] == GRAIN_PLAYING)
+		state[g] = GRAIN_STOPPING;
+}
+
+void GrainEngine::stopAll(){
+	for (int g = 0; g < GRAIN_MAX; g++)
+		stop(g);
+}
+
+int GrainEngine::active(){
+	int n = 0;
+	for (int g = 0; g < GRAIN_MAX; g++){
+		if (state[g] == GRAIN_PLAYING)
+			n++;
+	}
+	return n;
+}
+
+// (called by the ISR every block, so it's quick about it)
+bool __not_in_flash_func(GrainEngine::idle)(){
+	for (int g = 0; g < GRAIN_MAX; g++){
+		if (state[g] != GRAIN_FREE)
+			return false;
+	}
+	return true;
+}
+
+GrainEngine *GrainEngine::setLevel(float level){
+	iVolumeLevel = max(0, level * WAV_PWM_RANGE);
+	return this;
+}
+
+// Render each playing grain's whole block at once, straight out of its columns.
+void __not_in_flash_func(GrainEngine::render)(int32_t *mix, int frames, int volumeShift){
+	const int16_t *data = buf->data;
+	const uint32_t bufLen_fp = (uint32_t)buf->samples << GRAIN_POS_FBITS;
+	const uint32_t phaseEnd = (uint32_t)GRAIN_WINDOW_SIZE << GRAIN_PHASE_FBITS;
+	const int32_t master = iVolumeLevel;
+
+	for (int g = 0; g < GRAIN_MAX; g++){
+		if (state[g] == GRAIN_FREE)
+			continue;
+		if (state[g] == GRAIN_STOPPING) {
+			state[g] = GRAIN_FREE;
+			continue;
+		}
+
+		const int16_t *win = windows[shape[g]];
+		const int32_t level = (gain[g] * master) >> WAV_PWM_BITS;
+		const uint32_t pInc = inc[g];
+		const uint32_t wrap = (inc[g] >= 0) ? -bufLen_fp : bufLen_fp; // added when p runs off either end
+		const uint32_t phInc = phaseInc[g];
+		uint32_t p = pos[g];
+		uint32_t ph = phase[g];
+
+		for (int i = 0; i < frames; i++){
+			if (ph >= phaseEnd) {
+				state[g] = GRAIN_FREE;
+				break;
+			}
+			int32_t l = (level * win[ph >> GRAIN_PHASE_FBITS]) >> 15;
+			mix[i] += (data[p >> GRAIN_POS_FBITS] * l) >> volumeShift;
+
+			ph += phInc;
+			p += pInc;
+			if (p >= bufLen_fp)
+				p += wrap;
+		}
+
+		pos[g] = p;
+		phase[g] = ph;
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef __GRAINENGINE_H
+#define __GRAINENGINE_H
+
+// GrainEngine -- granular/slice playback for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "Picomix.h"
+
+//////////////////////////
+// Tweakable:
+//
+// GRAIN_MAX: how many grains each GrainEngine can play at once.
+// Each one costs about 24 bytes.
+#define GRAIN_MAX 48
+//
+// GRAIN_WINDOW_BITS: grain windows are lookup tables of 2^GRAIN_WINDOW_BITS entries.
+#define GRAIN_WINDOW_BITS 8
+//
+/////////////////////////
+
+#define GRAIN_WINDOW_SIZE (1 << GRAIN_WINDOW_BITS)
+#define GRAIN_POS_FBITS 12		// fractional bits of grain read positions & speeds
+															// (so buffers can be up to 2^20 samples long)
+#define GRAIN_PHASE_FBITS 16	// fractional bits of grain window phase
+
+
+////////////////
+// GrainEngine: plays many short, windowed snippets ("grains") of one shared AudioBuffer.
+//
+// Grains are much lighter than AudioTracks: each is just a start, position, speed,
+// gain and window phase, stored column-wise (structure-of-arrays)
+// so the ISR can render each grain's whole block in a tight loop.
+// The buffer must be mono; trigger() won't play anything else.
+// A grain lasts a fixed number of output frames, whatever its speed,
+// and frees itself when its window closes.
+//
+// Add it to a mixer with addSource(); trigger grains from the main loop (or core1).
+//
+class GrainEngine : public MixSource {
+public:
+	enum window_t : uint8_t { WINDOW_HANN, WINDOW_TRIANGLE, WINDOW_TUKEY, WINDOW_RECT, WINDOW_SHAPES };
+
+	GrainEngine(AudioBuffer &b);
+	GrainEngine(AudioBuffer *b);
+
+	GrainEngine(GrainEngine const&)     = delete;
+	void operator=(GrainEngine const&)  = delete;
+
+	AudioBuffer *buf;
+
+	// Start a grain at sample `start` of buf, lasting `length` output frames.
+	// speed may be negative; gain is 0 to 1 (or more, for trouble).
+	// Returns the grain's slot, or -1 if they're all busy.
+	int trigger(uint32_t start, uint32_t length, float speed = 1.0, float gain = 1.0, window_t window = WINDOW_HANN);
+	void stop(int grain);
+	void stopAll();
+	int active();
+
+	void render(int32_t *mix, int frames, int volumeShift) override;
+	bool idle() override;
+
+	volatile uint32_t iVolumeLevel = WAV_PWM_RANGE;	// master level for all grains, scaled like AudioTrack's
+	GrainEngine *setLevel(float level);
+
+private:
+	// Grain state, one column per field.
+	// Only the main loop starts a grain, and only the ISR ends one
+	// (stop() just asks it to), so the state byte is the only thing they both write.
+	volatile uint8_t state[GRAIN_MAX] = {};	// GRAIN_FREE, GRAIN_PLAYING or GRAIN_STOPPING
+	uint8_t shape[GRAIN_MAX];							// window_t
+	uint32_t pos[GRAIN_MAX];							// read position in buf, fixed-point
+	int32_t inc[GRAIN_MAX];								// speed, fixed-point
+	uint32_t phase[GRAIN_MAX];						// window phase, fixed-point; the grain ends at GRAIN_WINDOW_SIZE
+	uint32_t phaseInc[GRAIN_MAX];
+	int32_t gain[GRAIN_MAX];							// scaled like iVolumeLevel
+
+	static const uint8_t GRAIN_FREE = 0;
+	static const uint8_t GRAIN_PLAYING = 1;
+	static const uint8_t GRAIN_STOPPING = 2;
+
+	// Window lookup tables (Q15), shared by all GrainEngines:
+	static int16_t windows[WINDOW_SHAPES][GRAIN_WINDOW_SIZE];
+	static bool windowsReady;
+	static void makeWindows();
+};
+
+#endif  // __GRAINENGINE_H
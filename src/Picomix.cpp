@@ -3,6 +3,8 @@
 // License: https://creativecommons.org/licenses/by-sa/4.0/
 
 #include "Picomix.h"
+#include "SampleCache.h"
+#include "SampleBank.h"
 #include "pico/stdlib.h"
 #include "hardware/irq.h"
 #include "hardware/pwm.h"
@@ -20,7 +22,7 @@ void PWMStreamer::setup_audio_pwm_slice(unsigned char pin){
 
 	// initialize:
 	pCfg = pwm_get_default_config();
-	pwm_config_set_wrap(&pCfg, WAV_PWM_COUNT);
+	pwm_config_set_wrap(&pCfg, wrap);
 	pwm_init(pwmSlice, &pCfg, false);
 	pwm_set_irq_enabled(pwmSlice, false);
 
@@ -62,7 +64,8 @@ void PWMStreamer::setup_dma_channels(){
 		wavDataChConfig = dma_channel_get_default_config(wavDataCh[i]);
 		channel_config_set_read_increment(&wavDataChConfig, true);
 		channel_config_set_write_increment(&wavDataChConfig, false);
-		channel_config_set_transfer_data_size(&wavDataChConfig, DMA_SIZE_32);     // 32 bytes at a time (l & r 16-bit samples)
+		channel_config_set_transfer_data_size(&wavDataChConfig, 
+				(tBuf[i]->channels == 1) ? DMA_SIZE_16 : DMA_SIZE_32);     // one frame at a time (l & r 16-bit samples, or just one)
 
 		int treq = dma_get_timer_dreq(dmaTimer);
 		channel_config_set_dreq(&wavDataChConfig, treq);
@@ -72,15 +75,13 @@ void PWMStreamer::setup_dma_channels(){
 			&wavDataChConfig,                                           // this configuration
 			(void*)(PWM_BASE + PWM_CH0_CC_OFFSET + (0x14 * pwmSlice)),  // write to pwm channel (pwm structures are 0x14 bytes wide)
 			tBufDataPtr[i],
-			TRANSFER_BUFF_SAMPLES / 4,         // transfer count: 2 samples (32 bits) per transfer, and we're only transferring half of the buffer.
-																				 // TODO: deal with non-even-sized tx buffers
+			tBuf[i]->samples,                  // transfer count: one frame per transfer
 			false                              // Don't start immediately
 		);
-#if (PWMSTREAMER_DMA_INTERRUPT == DMA_IRQ_1)
-		dma_channel_set_irq1_enabled(wavDataCh[i], true);
-#else
-		dma_channel_set_irq0_enabled(wavDataCh[i], true);
-#endif
+		if (irq == DMA_IRQ_1)
+			dma_channel_set_irq1_enabled(wavDataCh[i], true);
+		else
+			dma_channel_set_irq0_enabled(wavDataCh[i], true);
 	}
 
 }
@@ -135,9 +136,16 @@ void PWMStreamer::start() {
 	pwm_set_mask_enabled((1 << pwmSlice) | pwm_hw->en);
 }
 
-// This is an inline method the ISR can call
-// to clear interrupts & reset streamer for the next interrupt.
-inline int PWMStreamer::resetIRQ(){
+// Has one of our channels raised our interrupt?
+bool __not_in_flash_func(PWMStreamer::irqPending)(){
+	uint32_t mask = (1u << wavDataCh[0]) | (1u << wavDataCh[1]);
+	if (irq == DMA_IRQ_1)
+		return dma_hw->ints1 & mask;
+	return dma_hw->ints0 & mask;
+}
+
+// The ISR calls this to clear interrupts & reset streamer for the next interrupt.
+int __not_in_flash_func(PWMStreamer::resetIRQ)(){
 	int idleSide;
 
   if (dma_channel_is_busy(wavDataCh[0])) {
@@ -147,11 +155,10 @@ inline int PWMStreamer::resetIRQ(){
   }
 
 	// clear interrupt
-#if (PWMSTREAMER_DMA_INTERRUPT == DMA_IRQ_1)
-  dma_channel_acknowledge_irq1(wavDataCh[idleSide]);
-#else
-  dma_channel_acknowledge_irq0(wavDataCh[idleSide]);
-#endif
+	if (irq == DMA_IRQ_1)
+		dma_channel_acknowledge_irq1(wavDataCh[idleSide]);
+	else
+		dma_channel_acknowledge_irq0(wavDataCh[idleSide]);
   // rewind idle channel DMA
   dma_channel_set_read_addr(wavDataCh[idleSide], tBufDataPtr[idleSide], false);
 
@@ -163,8 +170,16 @@ inline int PWMStreamer::resetIRQ(){
 ///  AudioTrack
 //////////////////////////////////////////////////
 
+AudioTrack::~AudioTrack(){
+	if (internalBuffer)
+		delete buf;
+	else if (cache)
+		cache->release(buf);
+}
+
 AudioTrack *AudioTrack::pause(){
 	playing = false;
+	Trc_command(TRACE_CMD_PAUSE);
 	// Dbg_println("paused");
 	return this;
 }
@@ -174,12 +189,15 @@ AudioTrack *AudioTrack::play(){
 	if (sampleBuffInc_fp5 > 0)  {
 		c = playbackStart;
 	} else {
-		c = min (playbackStart + playbackLen, buf->sampleLen);
+		c = min (playbackStart + playbackLen, buf->sampleStart + buf->sampleLen);
 	}
 
 	sampleBuffCursor_fp5 = inttofp5(c);
+	if (env.enabled)
+		env.trigger();
 	playing = true;
 	loopCount = max(1, loops);
+	Trc_command(TRACE_CMD_PLAY);
 	// Dbg_println("playing");
 	return this;
 }
@@ -188,6 +206,14 @@ AudioTrack *AudioTrack::play(){
 // setLoops(n) to loop N times before stopping
 AudioTrack *AudioTrack::setLoops(int l){
 	loops = max(-1, l);
+	Trc_command(TRACE_CMD_LOOPS);
+	return this;
+}
+
+// Loop only frames [start, start + len) of the buffer (len 0 to loop the whole playback region).
+AudioTrack *AudioTrack::setLoopRegion(uint32_t start, uint32_t len){
+	loopStart = start;
+	loopLen = len;
 	return this;
 }
 
@@ -202,6 +228,7 @@ AudioTrack *AudioTrack::setSpeed(float speed){
 		return this;
 
 	sampleBuffInc_fp5 = int(inttofp5(speed));
+	Trc_command(TRACE_CMD_SPEED);
 	// Dbg_printf("rate = %f, inc = %d\n", speed, sampleBuffInc_fp5);
 	return this;
 }
@@ -212,41 +239,96 @@ float AudioTrack::getSpeed(){
 	return speed;
 }
 
+// Higher priority tracks are the last to be shed when the CPU is overloaded.
+AudioTrack *AudioTrack::setPriority(uint8_t p){
+	priority = p;
+	return this;
+}
+
+// Times are in milliseconds; sustainLevel is 0 to 1.
+// The envelope starts when play() is called, and release() lets it go.
+AudioTrack *AudioTrack::setEnvelope(float attackMs, float decayMs, float sustainLevel, float releaseMs){
+	env.set(attackMs, decayMs, sustainLevel, releaseMs);
+	return this;
+}
+
+AudioTrack *AudioTrack::clearEnvelope(){
+	env.enabled = false;
+	return this;
+}
+
+AudioTrack *AudioTrack::release(){
+	if (env.enabled)
+		env.release();
+	else
+		pause();
+	return this;
+}
+
+// Effective volume right now, envelope included.
+uint32_t AudioTrack::loudness(){
+	if (! env.enabled)
+		return iVolumeLevel;
+	return (iVolumeLevel * (env.level >> 8)) >> 16;
+}
+
 // expecting a value between 0 and 1, or higher for trouble ...
 AudioTrack *AudioTrack::setLevel(float level){
 	iVolumeLevel = max(0, level * WAV_PWM_RANGE);
+	Trc_command(TRACE_CMD_LEVEL);
 	return this;
 }
 
-void AudioTrack::advance(){
+// Move the cursor ahead by some number of frames, handling loops & endings.
+// Returns ADVANCE_* bits for whatever happened along the way.
+uint8_t AudioTrack::advance(uint32_t frames){
+	uint8_t events = 0;
 	int32_t playbackStart_fp5 = inttofp5(playbackStart);
-	int32_t playbackEnd_fp5 = inttofp5(min((playbackStart + playbackLen), buf->sampleLen));
+	int32_t playbackEnd_fp5 = inttofp5(min((playbackStart + playbackLen), buf->sampleStart + buf->sampleLen));
+	int32_t loopStart_fp5 = playbackStart_fp5;
+	int32_t loopEnd_fp5 = playbackEnd_fp5;
+	if (loopLen) {
+		loopStart_fp5 = max(playbackStart_fp5, (int32_t)inttofp5(loopStart));
+		loopEnd_fp5 = min(playbackEnd_fp5, (int32_t)inttofp5((loopStart + loopLen)));
+		if (loopEnd_fp5 <= loopStart_fp5) { // (nothing left to loop)
+			loopStart_fp5 = playbackStart_fp5;
+			loopEnd_fp5 = playbackEnd_fp5;
+		}
+	}
+	int32_t loopLen_fp5 = loopEnd_fp5 - loopStart_fp5;
 
-	sampleBuffCursor_fp5 += sampleBuffInc_fp5;
+	// only wrap if we're coming from inside the loop (not from the head or tail)
+	int32_t from_fp5 = sampleBuffCursor_fp5;
+	sampleBuffCursor_fp5 += sampleBuffInc_fp5 * (int32_t)frames;
 
 	// sampleBuffInc_fp5 may be negative:
-	if (sampleBuffInc_fp5 > 0)
-		while (sampleBuffCursor_fp5 >= playbackEnd_fp5){
-			if (! isLooping()) {
-				playing = false;
-				sampleBuffCursor_fp5 = playbackStart_fp5;
-				//Dbg_println("played.");
-			} else {
-				sampleBuffCursor_fp5 -= (playbackEnd_fp5 - playbackStart_fp5);
-				loopCount--;
-			}
+	if (sampleBuffInc_fp5 > 0) {
+		while (isLooping() && loopLen_fp5 > 0 && from_fp5 < loopEnd_fp5 && sampleBuffCursor_fp5 >= loopEnd_fp5){
+			sampleBuffCursor_fp5 -= loopLen_fp5;
+			loopCount--;
+			events |= ADVANCE_LOOPED;
 		}
+		if (sampleBuffCursor_fp5 >= playbackEnd_fp5){
+			playing = false;
+			sampleBuffCursor_fp5 = playbackStart_fp5;
+			events |= ADVANCE_ENDED;
+		}
+	}
 
-	if (sampleBuffInc_fp5 < 0)
-		while (sampleBuffCursor_fp5 <= playbackStart_fp5){
-			if (! isLooping()) {
-				playing = false;
-				sampleBuffCursor_fp5 = playbackEnd_fp5;
-				//Dbg_println(".deyalp");
-			} else
-				sampleBuffCursor_fp5 += (playbackEnd_fp5 - playbackStart_fp5);
-				loopCount--;
+	if (sampleBuffInc_fp5 < 0) {
+		while (isLooping() && loopLen_fp5 > 0 && from_fp5 > loopStart_fp5 && sampleBuffCursor_fp5 <= loopStart_fp5){
+			sampleBuffCursor_fp5 += loopLen_fp5;
+			loopCount--;
+			events |= ADVANCE_LOOPED;
 		}
+		if (sampleBuffCursor_fp5 <= playbackStart_fp5){
+			playing = false;
+			sampleBuffCursor_fp5 = playbackEnd_fp5;
+			events |= ADVANCE_ENDED;
+		}
+	}
+
+	return events;
 }
 
 uint32_t AudioTrack::fillFromRawStream(Stream &f){
@@ -272,53 +354,242 @@ uint32_t AudioTrack::fillFromRawFile(fs::FS &fs, String filename){
 }
 
 
+//////////////////////////////////////////////////
+///  Envelope
+//////////////////////////////////////////////////
+
+// ms -> per-frame step that covers `range` in that time
+static uint32_t envelopeRate(float ms, uint32_t range){
+	uint32_t frames = max(1, (long)(ms * OUTPUT_SAMPLE_RATE / 1000));
+	return max((uint32_t)1, range / frames);
+}
+
+void Envelope::set(float attackMs, float decayMs, float sustainLevel, float releaseMs){
+	sustain = constrain(sustainLevel, 0.0, 1.0) * ENVELOPE_MAX;
+	attackInc = envelopeRate(attackMs, ENVELOPE_MAX);
+	decayDec = envelopeRate(decayMs, ENVELOPE_MAX - sustain);
+	releaseFrames = max(1, (long)(releaseMs * OUTPUT_SAMPLE_RATE / 1000));
+	enabled = true;
+}
+
+// Start (or restart) the attack from wherever the level is now, so retriggering doesn't click.
+void Envelope::trigger(){
+	stage = ATTACK;
+}
+
+// Fall from wherever we are to 0 in releaseFrames.
+void Envelope::release(){
+	releaseDec = max((uint32_t)1, level / releaseFrames);
+	stage = RELEASE;
+}
+
+
+//////////////////////////////////////////////////
+///  AudioRecorder
+//////////////////////////////////////////////////
+
+// Start recording from the top of the buffer.
+// Returns NULL (and doesn't record) if the buffer isn't mono.
+AudioRecorder *AudioRecorder::start(uint32_t maxFrames){
+	recording = false;
+	if (buf == NULL || buf->channels != 1) {
+		Dbg_println("recorder needs a mono buffer");
+		return NULL;
+	}
+
+	// If the ISR is tapping the mix into us, let it finish the block it may be in
+	// before we pull the ring out from under it.
+	MixerBase *m = mixer;
+	if (m)
+		m->waitForISR();
+
+	writePos = 0;
+	framesWritten = 0;
+	stopAfter = maxFrames;
+	startFrame = 0;
+	buf->sampleStart = 0;
+	buf->sampleLen = 0;
+	recording = true;
+	return this;
+}
+
+AudioRecorder *AudioRecorder::stop(){
+	recording = false;
+	return this;
+}
+
+// Recording frame number -> buffer position, if it hasn't been overwritten yet (or -1)
+long AudioRecorder::position(uint32_t frame){
+	uint32_t oldest = (framesWritten > (uint32_t)buf->samples) ? framesWritten - buf->samples : 0;
+	if (frame < oldest || frame > framesWritten)
+		return -1;
+	return frame % buf->samples;
+}
+
+// Loop a track (playing this recorder's buffer) over recorded frames [fromFrame, toFrame).
+// The loop may wrap around the end of the buffer.
+// Returns NULL if those frames aren't in the buffer.
+AudioTrack *AudioRecorder::loop(AudioTrack *t, uint32_t fromFrame, uint32_t toFrame){
+	long pos = position(fromFrame);
+	if (t->buf != buf || pos < 0 || toFrame <= fromFrame || position(toFrame) < 0)
+		return NULL;
+
+	t->playbackStart = pos;
+	t->playbackLen = toFrame - fromFrame;
+	return t;
+}
+
+// Copy as much as we can from a stream of signed 16-bit samples
+// (the same format fillFromRawStream() expects) into the ring.
+// Call it regularly from the main loop; it doesn't wait for more data.
+// Returns the number of frames recorded.
+uint32_t AudioRecorder::fillFromStream(Stream &f){
+	uint32_t total = 0;
+
+	while (recording) {
+		uint32_t room = buf->samples - writePos; // contiguous space before the ring wraps
+		if (stopAfter)
+			room = min(room, stopAfter - framesWritten);
+		room = min(room, (uint32_t)(f.available() / BYTES_PER_SAMPLE));
+		if (room == 0)
+			break;
+
+		// read straight into the ring, then scale in place:
+		int16_t *dst = &buf->data[writePos];
+		uint32_t got = f.readBytes((char *)dst, room * BYTES_PER_SAMPLE) / BYTES_PER_SAMPLE;
+		if (got == 0)
+			break;
+		for (uint32_t i = 0; i < got; i++)
+			dst[i] = dst[i] >> (16 - WAV_PWM_BITS);
+
+		advance(got);
+		total += got;
+	}
+	return total;
+}
+
+// Bookkeeping after writing some frames.
+// The buffer's sample is always the most recent buf->samples frames (or fewer),
+// so a track can play it directly.
+void AudioRecorder::advance(uint32_t frames){
+	writePos += frames;
+	while (writePos >= (uint32_t)buf->samples)
+		writePos -= buf->samples;
+	framesWritten += frames;
+
+	if (framesWritten >= (uint32_t)buf->samples) {
+		buf->sampleStart = writePos;
+		buf->sampleLen = buf->samples;
+	} else {
+		buf->sampleStart = 0;
+		buf->sampleLen = framesWritten;
+	}
+
+	if (stopAfter && framesWritten >= stopAfter)
+		recording = false;
+}
+
+
 ////////////////////////////////////////
-// Picomix object manages all the audio objects in the system,
-// and defines the ISR that pumps AudioTracks into txBufs.
+// MixerBase manages the audio objects of one Mixer,
+// and routes DMA interrupts to the Mixer's ISR that pumps AudioTracks into txBufs.
+
+MixerBase *MixerBase::registry[MIXER_MAX_INSTANCES] = {};
+volatile bool MixerBase::irqEnabled[2] = {};
+
+MixerBase::MixerBase(AudioTrack **t, int voices, uint8_t channels, uint32_t frames, uint16_t pwmWrap, unsigned dmaIrq):
+	transferBuffer{
+		AudioBuffer(channels, frames),
+		AudioBuffer(channels, frames)
+	},
+	pwm(transferBuffer[0], transferBuffer[1], pwmWrap, dmaIrq),
+	tracks(t),
+	maxVoices(voices)
+	{};
+
+MixerBase::~MixerBase(){
+	for (int i=0; i<MIXER_MAX_INSTANCES; i++){
+		if (registry[i] == this)
+			registry[i] = NULL;
+	}
+}
+
+// Service every mixer whose DMA raised this interrupt.
+void __not_in_flash_func(MixerBase::dispatch)(unsigned irq) {
+	for (int i=0; i<MIXER_MAX_INSTANCES; i++){
+		MixerBase *m = registry[i];
+		if (m && m->pwm.irq == irq && m->pwm.irqPending())
+			m->service();
+	}
+}
+
+void __not_in_flash_func(MixerBase::dispatchIRQ0)() {
+	dispatch(DMA_IRQ_0);
+}
+
+void __not_in_flash_func(MixerBase::dispatchIRQ1)() {
+	dispatch(DMA_IRQ_1);
+}
 
 // This gets called once at startup to set up PWM
-void Picomix::init(unsigned char ring) {
+void MixerBase::init(unsigned char ring) {
 
 	/////////////////////////
 	// set up digital limiter (used by ISR)
-	// interp1 will clamp signed integers to within +/- WAV_PWM_RANGE/2
+	// interp1 will clamp signed integers; the ISR sets the limits.
 	interp_config cfg = interp_default_config();
 	interp_config_set_clamp(&cfg, true);
 	interp_config_set_signed(&cfg, true);
 	interp_set_config(interp1, 0, &cfg);
 
-	interp1->base[0] = 0 - (WAV_PWM_RANGE / 2);;
-	interp1->base[1] = (WAV_PWM_RANGE / 2) -1;
-
 	////////////////////////
 	// set up PWM streaming
 	pwm.init(ring);
 
-	// install ISR
-	irq_set_exclusive_handler(PWMSTREAMER_DMA_INTERRUPT, ISR_play);
+	// register, & install the ISR if we're the first mixer on this interrupt
+	bool installed = false;
+	int slot = -1;
+	for (int i=0; i<MIXER_MAX_INSTANCES; i++){
+		if (registry[i] == this)
+			return;
+		if (registry[i] == NULL) {
+			if (slot < 0)
+				slot = i;
+		} else if (registry[i]->pwm.irq == pwm.irq) {
+			installed = true;
+		}
+	}
+	if (slot < 0) {
+		Dbg_println("error: too many mixers (see MIXER_MAX_INSTANCES)");
+		return;
+	}
+	registry[slot] = this;
+
+	if (! installed)
+		irq_set_exclusive_handler(pwm.irq, (pwm.irq == DMA_IRQ_1) ? dispatchIRQ1 : dispatchIRQ0);
 }
 
-AudioTrack *Picomix::addTrack(AudioTrack *t){
-	for (int i=0;i<MAX_TRACKS;i++){
-		if (trk[i] == NULL){
-			trk[i] = t;
-			return trk[i];
+AudioTrack *MixerBase::addTrack(AudioTrack *t){
+	for (int i=0;i<maxVoices;i++){
+		if (tracks[i] == NULL){
+			tracks[i] = t;
+			return tracks[i];
 		}
 	}
 	return NULL;
 }
 
-AudioTrack *Picomix::addTrack(uint8_t channels, long int sampleLength){
-	for (int i=0;i<MAX_TRACKS;i++){
-		if (trk[i] == NULL){
-			trk[i] = new AudioTrack(channels, sampleLength);
-			return trk[i];
+AudioTrack *MixerBase::addTrack(uint8_t channels, long int sampleLength){
+	for (int i=0;i<maxVoices;i++){
+		if (tracks[i] == NULL){
+			tracks[i] = new AudioTrack(channels, sampleLength);
+			return tracks[i];
 		}
 	}
 	return NULL;
 }
 
-AudioTrack *Picomix::addTrack(fs::FS &fs, String filename){
+AudioTrack *MixerBase::addTrack(fs::FS &fs, String filename){
 	File f = fs.open(filename, "r");
   if (!f) {
     Dbg_println("file open failed");
@@ -333,76 +604,161 @@ AudioTrack *Picomix::addTrack(fs::FS &fs, String filename){
 	return t;
 }
 
-void Picomix::start(){
-	enableISR(true);
-	pwm.start();
+// Share a cached copy of the sample instead of loading another one.
+AudioTrack *MixerBase::addTrack(SampleCache &cache, String filename){
+	AudioBuffer *b = cache.acquire(filename);
+	if (b == NULL)
+		return NULL;
+
+	AudioTrack *t = new AudioTrack(b);
+	t->cache = &cache;
+	if (addTrack(t) == NULL) {
+		delete t; // gives the buffer back
+		return NULL;
+	}
+	return t;
 }
 
-void Picomix::stop(){
-	pwm.stop();
-	enableISR(false);
+// Play a sample from a bank, with its loop points.
+AudioTrack *MixerBase::addTrack(SampleBank &bank, int index){
+	AudioTrack *t = bank.newTrack(index);
+	if (t == NULL)
+		return NULL;
+	if (addTrack(t) == NULL) {
+		delete t;
+		return NULL;
+	}
+	return t;
 }
 
-void Picomix::enableISR(bool on){
-	if (on) {
-		irq_set_enabled(PWMSTREAMER_DMA_INTERRUPT, true);
-	} else {
-		irq_set_enabled(PWMSTREAMER_DMA_INTERRUPT, false);
+AudioTrack *MixerBase::addTrack(SampleBank &bank, const char *name){
+	return addTrack(bank, bank.find(name));
+}
+
+// Remove a track from the mixer & delete it (and its buffer, if it owns one).
+// Don't call this from the ISR.
+void MixerBase::freeTrack(AudioTrack *t){
+	for (int i=0;i<maxVoices;i++){
+		if (tracks[i] == t){
+			tracks[i] = NULL;
+			waitForISR();
+			delete t;
+			return;
+		}
 	}
 }
 
-//
-// In our double-buffered DMA scheme, this ISR refills
-// the idle buffer with new samples and rewinds its
-// DMA channel, even as the other DMA continues
-// to pump the other buffer's samples through the PWM.
-//
-void __not_in_flash_func(Picomix::ISR_play)() {
-	static auto &my = onlyInstance();
-	AudioBuffer *idleTxBuf;
-	int idleSide;
+// Record the master mix into r (or stop tapping it, if r is NULL).
+// Recording begins at the next block after r->start().
+void MixerBase::record(AudioRecorder *r){
+	AudioRecorder *old = tap;
+	if (old && old != r && old->mixer == this)
+		old->mixer = NULL;
+	if (r)
+		r->mixer = this;
+	tap = r;
+}
 
-	my.ISRcounter++;
-
-	// Acknowledge interrupt, rewind DMA & determine idle side of the double buffer
-	idleSide = my.pwm.resetIRQ();
-
-	idleTxBuf = &my.transferBuffer[idleSide];
-
-	// fill idle channel buffer
-	for (int i = 0; i < idleTxBuf->samples; i += idleTxBuf->channels) {
-		long scaledSample = 0;
-
-		for (int t=0; t<MAX_TRACKS; t++){
-			if (my.trk[t] == NULL)
-				continue;
-			if (my.trk[t]->buf == NULL)
-				continue;
-			if (! my.trk[t]->playing)
-				continue;
-
-			if (my.trk[t]->iVolumeLevel == 0) {
-				my.trk[t]->advance();
-				continue;
-			}
-
-			scaledSample +=
-													(
-														my.trk[t]->buf->data[fp5toint(my.trk[t]->sampleBuffCursor_fp5)]
-														 * my.trk[t]->iVolumeLevel  // scale numerator (can be from 0 to more than WAV_PWM_RANGE
-													)
-													/ WAV_PWM_RANGE      // scale denominator
-				;
-			my.trk[t]->advance();
+// Mix another source in, starting with the next block.
+bool MixerBase::addSource(MixSource *src){
+	for (int i=0; i<MIXER_MAX_SOURCES; i++){
+		if (sources[i] == src)
+			return true;
+	}
+	for (int i=0; i<MIXER_MAX_SOURCES; i++){
+		if (sources[i] == NULL){
+			sources[i] = src;
+			return true;
 		}
+	}
+	return false;
+}
+
+// Stop mixing a source.  Like freeTrack(), this waits for the ISR to let go of it.
+void MixerBase::removeSource(MixSource *src){
+	for (int i=0; i<MIXER_MAX_SOURCES; i++){
+		if (sources[i] == src){
+			sources[i] = NULL;
+			waitForISR();
+			return;
+		}
+	}
+}
 
-		interp1->accum[0] = (short) scaledSample; // hard-limit with interpolator
+// The ISR may be using something we just took away from it, right now on the other core;
+// wait for it to finish a block without it.  (If it isn't running, there's nothing to wait for.)
+void MixerBase::waitForISR(){
+	unsigned long c = ISRcounter;
+	while (pwm.isStarted() && irqEnabled[pwm.irq == DMA_IRQ_1] && (ISRcounter - c) < 2)
+		;
+}
 
-		// put that sample in both channels
-		for (int j=0; j < idleTxBuf->channels; j++)
-			idleTxBuf->data[i+j] = interp1->peek[0] + (WAV_PWM_RANGE / 2); // shift to positive
+void MixerBase::start(){
+	enableISR(true);
+	pwm.start();
+}
+
+void MixerBase::stop(){
+	pwm.stop();
+
+	// leave the interrupt on for any other mixer still using it
+	for (int i=0; i<MIXER_MAX_INSTANCES; i++){
+		MixerBase *m = registry[i];
+		if (m && m != this && m->pwm.irq == pwm.irq && m->pwm.isStarted())
+			return;
+	}
+	enableISR(false);
+}
+
+void MixerBase::enableISR(bool on){
+	// (other mixers may share the interrupt, so this affects them too)
+	irqEnabled[pwm.irq == DMA_IRQ_1] = on;
+	irq_set_enabled(pwm.irq, on);
+}
+
+#ifdef PTRACE
+//////////
+// Trace ring reader: call these from the main loop or core1, never from the ISR.
+
+PicomixTrace picomixTrace;
+
+bool PicomixTrace::get(TraceRecord &r){
+	uint32_t t = tail;
+	if (t == head)
+		return false;
+	__sync_synchronize(); // don't read the record before we've seen the head
+	r = rec[t & (PTRACE_RING_SIZE - 1)];
+	__sync_synchronize(); // finish reading before handing the slot back
+	tail = t + 1;
+	return true;
+}
+
+const char *PicomixTrace::eventName(uint8_t event){
+	switch (event) {
+		case TRACE_LOOP: 		return "loop";
+		case TRACE_END: 		return "end";
+		case TRACE_STEAL: 	return "steal";
+		case TRACE_OVERRUN: return "overrun";
+		case TRACE_COMMAND: return "command";
+		default: 						return "?";
+	}
+}
+
+// Drain the ring & print it, one event per line.
+void PicomixTrace::dump(Print &out){
+	TraceRecord r;
+	while (get(r)) {
+		if (r.track == 0xFF)
+			out.printf("%10lu %-8s     %u\n", (unsigned long)r.frame, eventName(r.event), r.arg);
+		else
+			out.printf("%10lu %-8s t%02u %u\n", (unsigned long)r.frame, eventName(r.event), r.track, r.arg);
+	}
+	if (dropped) {
+		out.printf("(%lu trace records dropped)\n", (unsigned long)dropped);
+		dropped = 0;
 	}
 }
+#endif
 
 //////////
 //
@@ -8,10 +8,16 @@
 #include <functional>
 #include <FS.h>
 #include "hardware/pwm.h"
+#include "hardware/irq.h"
+#include "hardware/interp.h"
 
 //////////////////////////
 // Some potentially tweakable/tuneable values.
 //
+// WAV_PWM_BITS, TRANSFER_WINDOW_XFERS, PWMSTREAMER_DMA_INTERRUPT and MAX_TRACKS
+// configure the Picomix singleton.  If you need other configurations,
+// or more than one mixer, use the Mixer<> template (see below) directly.
+//
 // SDEBUG: send debug statements to serial port?
 // Use Dbg_print(), Dbg_println(), Dbg_printf(), etc., to send debug output.
 // If SDEBUG is defined, output is sent to the Arduino Serial object.
@@ -19,6 +25,16 @@
 // You may also redefine those macros to send debugging elsewhere.
 #define SDEBUG
 //
+// PTRACE: record ISR events (loops, track endings, voice shedding, overruns, commands)
+// into a lock-free ring buffer, which the main loop or core1 can drain & print with
+// picomixTrace.dump(Serial) or read one record at a time with picomixTrace.get().
+// If PTRACE is undefined, all tracing code is stripped from the binary.
+// Tracing supports one running mixer (see "ISR event tracing" below).
+//#define PTRACE
+//
+// PTRACE_RING_SIZE: how many trace records to keep (must be a power of 2, 8 bytes each.)
+#define PTRACE_RING_SIZE 256
+//
 // WAV_PWM_BITS: PWM sample resolution.
 // There's a tradeoff between PWM bit resolution & sample rate.
 // Choosing 10-bit audio (at 133mhz clock rate) has the advantage 
@@ -56,8 +72,7 @@
 // A larger buffer means fewer interrupts, perhaps more efficient.
 // OTOH, when this was set to 80 (at 133mhz), the resulting interrrupt frequency
 // injected audible noise into a circuit. Lower values keep it supersonic.
-// (WARNING: In this release, TRANSFER_WINDOW_XFERS must be an even number 
-// or else samples will be dropped. See TODO ...)
+// (TRANSFER_WINDOW_XFERS must be an even number; the compiler will remind you.)
 #define TRANSFER_WINDOW_XFERS 40
 //
 //
@@ -68,6 +83,13 @@
 //#define PWMSTREAMER_DMA_INTERRUPT DMA_IRQ_1
 //
 //
+// MIXER_MAX_INSTANCES: how many Mixers (each with its own PWM pins) may run at once.
+#define MIXER_MAX_INSTANCES 4
+//
+// MIXER_MAX_SOURCES: how many MixSources (like GrainEngines) each Mixer can mix in besides its tracks.
+#define MIXER_MAX_SOURCES 4
+//
+//
 // MAX_TRACKS: How many tracks will the ISR try to mix?
 // FYI, mixing 24 tracks with the above settings 
 // seems to consume about 80% of one core's cycles. 
@@ -77,6 +99,18 @@
 // you can probably mix even more tracks than this:
 #define MAX_TRACKS 24
 //
+//
+// GOVERNOR_*: CPU load governor.
+// The ISR times how long it takes to render each block of samples.
+// If that gets above GOVERNOR_HIGH_PCT percent of the time it takes to play the block,
+// the governor starts shedding voices: the quietest, lowest-priority tracks are
+// first decimated (rendered at half rate), then dropped (silenced, but their cursors keep moving).
+// Once render time has stayed below GOVERNOR_LOW_PCT for GOVERNOR_RECOVER_BLOCKS blocks in a row,
+// voices are restored one step at a time.
+#define GOVERNOR_HIGH_PCT 85
+#define GOVERNOR_LOW_PCT 60
+#define GOVERNOR_RECOVER_BLOCKS 64
+//
 /// End user-tweakable section.
 /////////////////////////////////////
 
@@ -110,6 +144,80 @@ typedef int32_t fp5_t;
 #endif
 
 
+///////////////////
+// ISR event tracing:
+//
+// The ISR is the only writer and one reader (on either core) drains it,
+// so no locks are needed.  When the ring is full, new records are dropped & counted.
+//
+// There's only the one ring, & records don't say which mixer wrote them, so trace with
+// only one Mixer running: several mixers' ISRs (maybe on different cores) would be
+// several unsynchronized writers, & would corrupt it.
+#ifdef PTRACE
+enum traceEvent_t : uint8_t {
+	TRACE_LOOP = 1,		// track wrapped around its loop; arg = loops left, or TRACE_LOOPS_FOREVER
+	TRACE_END,				// track reached its end & stopped
+	TRACE_STEAL,			// governor dropped a track; arg = governor shed level
+	TRACE_OVERRUN,		// ISR took longer than a whole window; arg = render time in us
+	TRACE_COMMAND,		// ISR picked up transport commands; arg = TRACE_CMD_* bits
+};
+
+#define TRACE_LOOPS_FOREVER 0xFFFF
+
+#define TRACE_CMD_PLAY 	1
+#define TRACE_CMD_PAUSE 2
+#define TRACE_CMD_SPEED 4
+#define TRACE_CMD_LEVEL 8
+#define TRACE_CMD_LOOPS 16
+
+struct TraceRecord {
+	uint32_t frame;			// output frame count when it happened
+	uint8_t event;			// traceEvent_t
+	uint8_t track;			// track slot, or 0xFF if n/a
+	uint16_t arg;
+};
+
+struct PicomixTrace {
+	TraceRecord rec[PTRACE_RING_SIZE];
+	volatile uint32_t head = 0;
+	volatile uint32_t tail = 0;
+	volatile uint32_t dropped = 0;
+
+	// set by the ISR before rendering each track:
+	uint32_t blockFrame = 0;
+	uint8_t blockTrack = 0xFF;
+
+	// (ISR side)
+	inline void put(uint8_t event, uint32_t offset, uint16_t arg){
+		uint32_t h = head;
+		if (h - tail >= PTRACE_RING_SIZE) {
+			dropped++;
+			return;
+		}
+		rec[h & (PTRACE_RING_SIZE - 1)] = { blockFrame + offset, event, blockTrack, arg };
+		__sync_synchronize(); // publish the record before the new head
+		head = h + 1;
+	}
+
+	// (reader side)
+	bool get(TraceRecord &r);
+	void dump(Print &out);
+	static const char *eventName(uint8_t event);
+};
+extern PicomixTrace picomixTrace;
+
+#define Trc_context(frame, track) { picomixTrace.blockFrame = (frame); picomixTrace.blockTrack = (track); }
+#define Trc_event(event, offset, arg) picomixTrace.put((event), (offset), (arg))
+// (not atomic: a command bit set while the ISR clears others can be lost; it's only a trace)
+#define Trc_command(bits) { tracedCommands |= (bits); }
+
+#else
+#define Trc_context(frame, track) {}
+#define Trc_event(event, offset, arg) {}
+#define Trc_command(bits) {}
+#endif
+
+
 ///////////////////
 // PWM math:
 // 
@@ -129,6 +237,9 @@ typedef int32_t fp5_t;
 #define TRANSFER_BUFF_CHANNELS 2
 #define TRANSFER_BUFF_SAMPLES ( TRANSFER_WINDOW_XFERS * TRANSFER_BUFF_CHANNELS)
 #define TRANSFER_BUFF_BYTES 	( TRANSFER_BUFF_SAMPLES * BYTES_PER_SAMPLE )
+//
+// The DMA timer plays frames at (nearly) this rate:
+#define OUTPUT_SAMPLE_RATE ( F_CPU / PWM_DMA_TIMER_DEM * PWM_DMA_TIMER_NUM )
 
 
 ////////////////
@@ -142,6 +253,7 @@ struct AudioBuffer {
 	const uint8_t channels; // # of interleaved channels of samples: mono = 1, stereo = 2
 	const long int samples;	// number of N-channel samples in this buffer
 	int16_t *data;
+	const bool ownsData = true;
 
 	AudioBuffer(uint8_t c, long int s): 
 		channels(c), 
@@ -149,8 +261,17 @@ struct AudioBuffer {
 		data(new int16_t[c * s])
 		{ };
 
+	// Or it can use samples that live somewhere else (like a SampleBank), without owning them:
+	AudioBuffer(uint8_t c, long int s, int16_t *d): 
+		channels(c), 
+		samples(s), 
+		data(d),
+		ownsData(false)
+		{ };
+
 	~AudioBuffer(){
-		delete[] data;
+		if (ownsData)
+			delete[] data;
 	};
 
 	inline uint32_t byteLen(){
@@ -181,9 +302,16 @@ struct AudioBuffer {
 // The ISR in Picomix rewinds the DMA channels and refills the buffers.
 // 
 //
+// Each transfer buffer holds (samples) frames of (channels) 16-bit samples.
+// Stereo frames go to the PWM slice's A & B channels in one 32-bit transfer;
+// mono frames are written 16 bits at a time, which the bus replicates to both channels.
+//
 struct PWMStreamer {
 public:
-	PWMStreamer(AudioBuffer &aB0, AudioBuffer &aB1){
+	PWMStreamer(AudioBuffer &aB0, AudioBuffer &aB1, uint16_t pwmWrap = WAV_PWM_COUNT, unsigned dmaIrq = PWMSTREAMER_DMA_INTERRUPT):
+		wrap(pwmWrap),
+		irq(dmaIrq)
+	{
 		tBuf[0] = &aB0;
 		tBuf[1] = &aB1;
 		tBufDataPtr[0] = tBuf[0]->data;
@@ -195,8 +323,11 @@ public:
   void stop();
   bool isStarted();
 	int resetIRQ();
+	bool irqPending();
 
   AudioBuffer *tBuf[2];
+	const uint16_t wrap;					// PWM counter wraps after this value
+	const unsigned irq;						// DMA_IRQ_0 or DMA_IRQ_1
 
   int wavDataCh[2] = {-1, -1};  // -1 = DMA channel not assigned yet.
   int pwmSlice = -1;						// ditto
@@ -211,15 +342,83 @@ private:
 };
 
 
+///////////////////
+// Envelope: an integer ADSR envelope generator.
+// The ISR steps it once per block, and the track's volume ramps linearly
+// across the block from the old envelope level to the new one.
+// Levels are fractions of ENVELOPE_MAX; rates are per-frame increments.
+//
+#define ENVELOPE_MAX (1 << 24)
+struct Envelope {
+	enum stage_t : uint8_t { IDLE, ATTACK, DECAY, SUSTAIN, RELEASE };
+
+	bool enabled = false;
+	volatile stage_t stage = IDLE;
+	volatile uint32_t level = 0;
+
+	uint32_t attackInc = ENVELOPE_MAX;
+	uint32_t decayDec = ENVELOPE_MAX;
+	uint32_t sustain = ENVELOPE_MAX;
+	uint32_t releaseFrames = 1;
+	uint32_t releaseDec = ENVELOPE_MAX;
+
+	void set(float attackMs, float decayMs, float sustainLevel, float releaseMs);
+	void trigger();
+	void release();
+
+	// (ISR side) Step the envelope ahead by some frames; returns the new level.
+	// When the release is done the envelope goes IDLE at level 0.
+	inline uint32_t step(uint32_t frames){
+		uint32_t l = level;
+		switch (stage) {
+			case ATTACK:
+				if (ENVELOPE_MAX - l > attackInc * frames) {
+					l += attackInc * frames;
+				} else {
+					l = ENVELOPE_MAX;
+					stage = DECAY;
+				}
+				break;
+			case DECAY:
+				if (l > sustain + decayDec * frames) {
+					l -= decayDec * frames;
+				} else {
+					l = sustain;
+					stage = SUSTAIN;
+				}
+				break;
+			case RELEASE:
+				if (l > releaseDec * frames) {
+					l -= releaseDec * frames;
+				} else {
+					l = 0;
+					stage = IDLE;
+				}
+				break;
+			default:
+				break;
+		}
+		level = l;
+		return l;
+	}
+};
+
+
 ///////////////////
 // AudioTrack: plays samples from an AudioBuffer at an adjustable rate & level.
 // It handles play/pause/seek (with wraparound) and looping.
 // playbackStart & playbackLen allow trimming to a subset of the sample.
+// loopStart & loopLen (if set) loop just part of that, like a sampler's loop points:
+// play from playbackStart, repeat the loop region, then play on to the end.
 //
 #define LOOPFOREVER -1
+class SampleCache;
+class SampleBank;
+class MixerBase;
 struct AudioTrack {
 	AudioBuffer *buf;
 	bool internalBuffer = false;
+	SampleCache *cache = NULL;	// if set, buf is released back to this cache when we're done with it
 
 	// AudioTrack can be instantiated with an existing buffer like so:
 	AudioTrack(AudioBuffer &b):
@@ -244,10 +443,7 @@ struct AudioTrack {
 		internalBuffer(true)
 		{};
 
-	~AudioTrack(){
-		if (internalBuffer)
-			delete buf;
-	}
+	~AudioTrack();
 
 	volatile uint32_t iVolumeLevel; // 0 - WAV_PWM_RANGE, or higher for clipping
 	volatile fp5_t sampleBuffCursor_fp5 =	inttofp5(0);
@@ -255,18 +451,121 @@ struct AudioTrack {
 	bool playing = false;
 	uint32_t playbackStart = 0; 
 	uint32_t playbackLen; 
+	uint32_t loopStart = 0;
+	uint32_t loopLen = 0;		// 0 = loop the whole playback region
+	uint8_t priority = 0;		// when overloaded, the governor sheds low-priority tracks first
+	Envelope env;						// volume envelope, if enabled
+#ifdef PTRACE
+	volatile uint8_t tracedCommands = 0; // TRACE_CMD_* bits not yet seen by the ISR
+#endif
 
 	// These all return a pointer to the object, so they can be chained:
   AudioTrack *play();
 	AudioTrack *pause(); 
 	AudioTrack *setLevel(float level);
 	AudioTrack *setLoops(int l);
+	AudioTrack *setLoopRegion(uint32_t start, uint32_t len);
 	AudioTrack *setSpeed(float speed);
+	AudioTrack *setPriority(uint8_t p);
+	AudioTrack *setEnvelope(float attackMs, float decayMs, float sustainLevel, float releaseMs);
+	AudioTrack *clearEnvelope();
+	AudioTrack *release();	// start the envelope's release (or just pause, without one)
 
 	float getSpeed();
 	bool isLooping();
+	uint32_t loudness();
+
+	// advance() reports what happened along the way:
+	static const uint8_t ADVANCE_LOOPED = 1;
+	static const uint8_t ADVANCE_ENDED = 2;
+	uint8_t advance(uint32_t frames = 1);
+
+	// Mix the next block of this track's samples into an accumulator.
+	// (sample * volume) >> VolumeShift puts it at the mixer's output resolution.
+	// With stride > 1, each sample is held for stride frames,
+	// which is crunchier but proportionally cheaper.
+	template <int VolumeShift>
+	void render(int32_t *mix, int frames, int stride = 1){
+		if (env.enabled) {
+			renderEnvelope<VolumeShift>(mix, frames, stride);
+			return;
+		}
+
+		if (iVolumeLevel == 0) {
+			traceAdvance(advance(frames), 0);
+			return;
+		}
+
+		int32_t vol = iVolumeLevel;
+		for (int i = 0; i < frames && playing; i += stride) {
+			int32_t scaledSample = (sampleAtCursor() * vol) >> VolumeShift;
+			int n = min(stride, frames - i);
+			for (int j = 0; j < n; j++)
+				mix[i+j] += scaledSample;
+			traceAdvance(advance(n), i + n);
+		}
+	}
+
+	// Same as render(), but the volume ramps from the envelope's level at the start
+	// of the block to its level at the end.  Volumes are 16.16 fixed point in here.
+	template <int VolumeShift>
+	void renderEnvelope(int32_t *mix, int frames, int stride){
+		uint32_t vol = iVolumeLevel;
+		int32_t v0 = (vol * (env.level >> 8)) >> 16;
+		int32_t v1 = (vol * (env.step(frames) >> 8)) >> 16;
+		int32_t v = v0 << 16;
+		int32_t dv = ((v1 - v0) * 65536) / frames;
+
+		for (int i = 0; i < frames && playing; i += stride) {
+			int32_t sample = sampleAtCursor();
+			int n = min(stride, frames - i);
+			for (int j = 0; j < n; j++) {
+				mix[i+j] += (sample * (v >> 16)) >> VolumeShift;
+				v += dv;
+			}
+			traceAdvance(advance(n), i + n);
+		}
+
+		// released all the way down? then we're done.
+		if (env.stage == Envelope::IDLE && playing) {
+			playing = false;
+			Trc_event(TRACE_END, frames, 0);
+		}
+	}
+
+	// Move along without mixing anything (when the governor drops us),
+	// so we come back in time and at the envelope's level by then.
+	inline void skip(int frames){
+		traceAdvance(advance(frames), 0);
+		if (! env.enabled)
+			return;
+		env.step(frames);
+		if (env.stage == Envelope::IDLE && playing) {
+			playing = false;
+			Trc_event(TRACE_END, frames, 0);
+		}
+	}
+
+	// the sample may wrap around the end of the buffer:
+	inline int32_t sampleAtCursor(){
+		uint32_t c = fp5toint(sampleBuffCursor_fp5);
+		if (c >= buf->samples)
+			c -= buf->samples;
+		return buf->data[c];
+	}
+
+	// Log loops & endings from the ISR.
+#ifdef PTRACE
+	inline void traceAdvance(uint8_t events, uint32_t offset){
+		if (events & ADVANCE_LOOPED)
+			Trc_event(TRACE_LOOP, offset, (loops < 0) ? TRACE_LOOPS_FOREVER : (uint16_t)constrain(loopCount, 0, 0xFFFE));
+		if (events & ADVANCE_ENDED)
+			Trc_event(TRACE_END, offset, 0);
+	}
+#else
+	inline void traceAdvance(uint8_t, uint32_t){}
+#endif
 
-	void advance();
 	uint32_t fillFromRawStream(Stream &f);
 	uint32_t fillFromRawFile(fs::FS &fs, String filename);
 
@@ -276,55 +575,435 @@ private:
 
 };
 
-class Picomix {
+///////////////////
+// AudioRecorder: records into an AudioBuffer used as a ring,
+// either from the master mix (see Picomix::record()) or from a Stream of samples.
+// While it records, the buffer's sampleStart & sampleLen always describe the latest audio,
+// so an AudioTrack can play the recording (or loop part of it) right away.
+//
+// Recorded frames are numbered from 0 at start().  When recording the mix,
+// recording frame N is mixer frame (startFrame + N).
+//
+// Recordings are mono (so is the mix), & the buffer must be too; start() refuses others.
+//
+struct AudioRecorder {
+	AudioBuffer *buf;
+
+	AudioRecorder(AudioBuffer &b): buf(&b) {};
+	AudioRecorder(AudioBuffer *b): buf(b) {};
 
-	///////////////////////////////
-	// This section implements the singleton pattern for c++:
-	// https://stackoverflow.com/questions/1008019/how-do-you-implement-the-singleton-design-pattern
-public:
-	static Picomix& onlyInstance(){
-		static Picomix singleGuy;
-		return singleGuy;
+	volatile bool recording = false;
+	volatile uint32_t framesWritten = 0;	// frames recorded since start()
+	volatile uint32_t startFrame = 0;			// mixer frameCount when recording the mix began
+	uint32_t stopAfter = 0;								// stop after this many frames (0 = never; the ring just wraps)
+	MixerBase *volatile mixer = NULL;			// the mixer whose mix we're tapping, if any (see MixerBase::record())
+
+	AudioRecorder *start(uint32_t maxFrames = 0);
+	AudioRecorder *stop();
+
+	long position(uint32_t frame);
+	AudioTrack *loop(AudioTrack *t, uint32_t fromFrame, uint32_t toFrame);
+
+	uint32_t fillFromStream(Stream &f);
+
+	// (ISR side)
+	inline void beginBlock(uint32_t mixerFrame){
+		if (framesWritten == 0)
+			startFrame = mixerFrame;
+		blockFrames = 0;
 	}
-private:
-	Picomix() {
-		for (int i=0;i<MAX_TRACKS;i++){
-			trk[i] = NULL;
-		}
+	inline void put(int16_t sample){
+		if (stopAfter && framesWritten + blockFrames >= stopAfter)
+			return;
+		uint32_t p = writePos + blockFrames;
+		if (p >= (uint32_t)buf->samples)
+			p -= buf->samples;
+		buf->data[p] = sample;
+		blockFrames++;
 	}
-public:
-	Picomix(Picomix const&)     = delete;
-	void operator=(Picomix const&)  = delete;
-	//
-	// end singleton section
-	///////////////////////////////
+	inline void endBlock(){
+		advance(blockFrames);
+	}
+
+private:
+	volatile uint32_t writePos = 0;
+	uint32_t blockFrames = 0;
+	void advance(uint32_t frames);
+};
+
 
+////////////////////////////////////////
+// MixSource: something other than an AudioTrack that a Mixer can mix in (see GrainEngine).
+// The ISR calls render() once per block to add that many frames into mix.
+// Levels are scaled like AudioTrack::iVolumeLevel, and (sample * level) >> volumeShift
+// puts a sample at the mixer's output resolution.
+//
+struct MixSource {
+	virtual ~MixSource() {};
+	virtual void render(int32_t *mix, int frames, int volumeShift) = 0;
+	virtual bool idle() { return false; }	// true if render() would add nothing
+};
+
+
+////////////////////////////////////////
+// MixerBase: everything a Mixer does that doesn't depend on its configuration:
+// the tracks, transport, stats, governor state and the interrupt plumbing.
+// Several Mixers may share a DMA interrupt; each one services its own DMA channels.
+//
+class MixerBase {
 public:
+	MixerBase(AudioTrack **tracks, int voices, uint8_t channels, uint32_t frames, uint16_t pwmWrap, unsigned dmaIrq);
+	virtual ~MixerBase();	// (stop() it first)
+	MixerBase(MixerBase const&)     = delete;
+	void operator=(MixerBase const&)  = delete;
+
 	void start();
 	void stop();
 
-  AudioBuffer transferBuffer[2] = {
-		AudioBuffer(TRANSFER_BUFF_CHANNELS, TRANSFER_BUFF_SAMPLES / 2),
-		AudioBuffer(TRANSFER_BUFF_CHANNELS, (TRANSFER_BUFF_SAMPLES - (TRANSFER_BUFF_SAMPLES / 2)))
-	};
-	PWMStreamer pwm{transferBuffer[0],transferBuffer[1]};
-
-	AudioTrack *trk[MAX_TRACKS];
+  AudioBuffer transferBuffer[2];
+	PWMStreamer pwm;
 
 	// some performance profiling info:
 	volatile unsigned long ISRcounter = 0;
+	volatile uint32_t frameCount = 0;			// output frames rendered since init()
+	volatile uint32_t renderUs = 0;				// time spent in the last ISR
+	volatile uint32_t peakRenderUs = 0;		// worst time seen so far (write 0 to reset)
+	volatile unsigned long overruns = 0;	// ISRs that took longer than a whole window (probably glitched)
+
+	// CPU load governor:
+	bool governor = true;								// set false to never shed voices
+	volatile uint8_t shedLevel = 0;			// 0 = all voices rendered; each step decimates or drops one more voice
 
+	// Idle fast path: when nothing is playing (or recording), the ISR stops rendering
+	// once both halves of the double buffer are silent, & lets the DMA replay them.
+	volatile bool idle = false;
+	volatile unsigned long idleBlocks = 0;	// blocks skipped that way
+
+	// Call init() on the core that should run the mixer ISR.
   void init(unsigned char ring);  
 	void enableISR(bool on);
 
 	AudioTrack *addTrack(uint8_t channels, long int sampleLen);
 	AudioTrack *addTrack(AudioTrack *t);
 	AudioTrack *addTrack(fs::FS &fs, String filename);
+	AudioTrack *addTrack(SampleCache &cache, String filename);
+	AudioTrack *addTrack(SampleBank &bank, int index);
+	AudioTrack *addTrack(SampleBank &bank, const char *name);
+
+	void freeTrack(AudioTrack *t);
+	void waitForISR();	// until the ISR has let go of anything just taken away from it
+
+	void record(AudioRecorder *r);
+	AudioRecorder *volatile tap = NULL;
+
+	bool addSource(MixSource *s);
+	void removeSource(MixSource *s);
+	MixSource *volatile sources[MIXER_MAX_SOURCES] = {};
+
+protected:
+	AudioTrack **const tracks;
+	const int maxVoices;
+
+	// The master sample mixer, called from the DMA interrupt:
+	virtual void service() = 0;
+
+	// governor internals:
+	enum renderMode_t : uint8_t { RENDER_FULL, RENDER_DECIMATE, RENDER_DROP };
+	uint32_t calmBlocks = 0;
+
+private:
+	static MixerBase *registry[MIXER_MAX_INSTANCES];
+	static volatile bool irqEnabled[2];		// by DMA_IRQ_0 / DMA_IRQ_1, as set by enableISR()
+	static void dispatch(unsigned irq);
+	static void dispatchIRQ0();
+	static void dispatchIRQ1();
+};
+
+
+////////////////////////////////////////
+// Mixer: mixes up to MaxVoices AudioTracks into a pair of PWM outputs
+// at Bits of resolution, Window DMA transfers per double-buffer cycle,
+// with Channels (1 or 2) samples per frame, interrupting on Irq.
+//
+// All of those are compile-time constants, so each configuration gets
+// its own ISR with its loops sized & its scaling folded into shifts.
+// Several Mixers (on different pins) can run at once:
+//
+//   Mixer<10, 8, 40, 2> left;
+//   Mixer<11, 4, 40, 2, DMA_IRQ_1> right;
+//
+template <int Bits, int MaxVoices, int Window, int Channels, unsigned Irq = DMA_IRQ_0>
+class Mixer : public MixerBase {
+public:
+	static constexpr int32_t Range = 1 << Bits;
+	static constexpr int Frames = Window / 2;		// frames in each half of the double buffer
+	static constexpr uint32_t WindowUs = Frames * (1000000ULL * PWM_DMA_TIMER_DEM / PWM_DMA_TIMER_NUM) / F_CPU;
+	static constexpr uint32_t GovernorHighUs = WindowUs * GOVERNOR_HIGH_PCT / 100;
+	static constexpr uint32_t GovernorLowUs = WindowUs * GOVERNOR_LOW_PCT / 100;
+
+	// Samples & volume levels are both scaled to WAV_PWM_BITS;
+	// this one shift takes their product to our output resolution.
+	static constexpr int VolumeShift = 2 * WAV_PWM_BITS - Bits;
+
+	static_assert(Bits >= 8 && Bits <= 15, "Mixer: Bits must be between 8 and 15");
+	static_assert(Window > 0 && (Window % 2) == 0, "Mixer: Window must be a positive even number");
+	static_assert(Channels == 1 || Channels == 2, "Mixer: Channels must be 1 or 2");
+	static_assert(MaxVoices > 0 && MaxVoices < 0xFF, "Mixer: MaxVoices must be between 1 and 254");
+	static_assert(VolumeShift >= 0, "Mixer: Bits can't be more than twice WAV_PWM_BITS");
+
+	Mixer(): MixerBase(trk, MaxVoices, Channels, Frames, Range - 1, Irq) {
+		for (int i=0;i<MaxVoices;i++){
+			trk[i] = NULL;
+		}
+	}
+
+	AudioTrack *trk[MaxVoices];
+
+protected:
+	void service() override;
 
-	// void freeTrack(AudioTrack *t);
 private:
-	// The master sample mixer:
-  static void ISR_play();
+	int32_t mixBuf[Frames];
+	uint8_t silentHalves = 0;		// how many halves of the double buffer hold silence
+#ifdef PTRACE
+	renderMode_t lastMode[MaxVoices] = {};
+#endif
+
+	bool nothingToPlay();
+	void planRender(renderMode_t *mode);
+	void updateGovernor(uint32_t elapsedUs);
+};
+
+// Is there anything at all to render this block?
+template <int Bits, int MaxVoices, int Window, int Channels, unsigned Irq>
+inline bool Mixer<Bits, MaxVoices, Window, Channels, Irq>::nothingToPlay(){
+	for (int t=0; t<MaxVoices; t++) {
+		if (trk[t] != NULL && trk[t]->buf != NULL && trk[t]->playing)
+			return false;
+	}
+	for (int i=0; i<MIXER_MAX_SOURCES; i++){
+		MixSource *src = sources[i];
+		if (src && ! src->idle())
+			return false;
+	}
+	AudioRecorder *rec = tap;
+	if (rec && rec->recording)
+		return false;
+	return true;
+}
+
+// Decide how each track gets rendered this block.
+// When the governor has shed N steps, the N lowest-ranked playing tracks are affected:
+// the bottom half of those are dropped, the rest are decimated.
+// Tracks rank by priority, then by volume level.  The top-ranked track is never shed,
+// and the shed level is capped to what the playing tracks can actually give up.
+template <int Bits, int MaxVoices, int Window, int Channels, unsigned Irq>
+void Mixer<Bits, MaxVoices, Window, Channels, Irq>::planRender(renderMode_t *mode){
+	uint32_t key[MaxVoices];
+	bool ranked[MaxVoices];
+	int t, n = 0;
+
+	for (t=0; t<MaxVoices; t++) {
+		mode[t] = RENDER_FULL;
+		ranked[t] = true;
+		if (trk[t] == NULL || trk[t]->buf == NULL || ! trk[t]->playing)
+			continue;
+		key[t] = ((uint32_t)trk[t]->priority << 24) | min(trk[t]->loudness(), (uint32_t)0xFFFFFF);
+		ranked[t] = false;
+		n++;
+	}
+
+	// beyond this, we'd be shedding the top track too, and recovering would only take longer:
+	int maxShed = (n > 0) ? 2 * (n - 1) : 0;
+	if (shedLevel > maxShed)
+		shedLevel = maxShed;
+
+	int level = shedLevel;
+	int shed = min(level, n - 1);
+	for (int rank = 0; rank < shed; rank++) {
+		int victim = -1;
+		for (t=0; t<MaxVoices; t++) {
+			if (ranked[t])
+				continue;
+			if (victim < 0 || key[t] < key[victim])
+				victim = t;
+		}
+		if (victim < 0)
+			break;
+		mode[victim] = (rank < level / 2) ? RENDER_DROP : RENDER_DECIMATE;
+		ranked[victim] = true;
+	}
+}
+
+// Shed a voice quickly when we're near the end of our budget;
+// restore voices slowly once things have calmed down.
+template <int Bits, int MaxVoices, int Window, int Channels, unsigned Irq>
+void Mixer<Bits, MaxVoices, Window, Channels, Irq>::updateGovernor(uint32_t elapsedUs){
+	renderUs = elapsedUs;
+	if (elapsedUs > peakRenderUs)
+		peakRenderUs = elapsedUs;
+	if (elapsedUs > WindowUs) {
+		overruns++;
+		Trc_context(frameCount, 0xFF);
+		Trc_event(TRACE_OVERRUN, 0, (uint16_t)min(elapsedUs, (uint32_t)0xFFFF));
+	}
+
+	if (! governor) {
+		shedLevel = 0;
+		return;
+	}
+
+	if (elapsedUs > GovernorHighUs) {
+		if (shedLevel < 2 * MaxVoices)
+			shedLevel++;
+		calmBlocks = 0;
+	} else if (elapsedUs < GovernorLowUs && shedLevel > 0) {
+		if (++calmBlocks >= GOVERNOR_RECOVER_BLOCKS) {
+			shedLevel--;
+			calmBlocks = 0;
+		}
+	} else {
+		calmBlocks = 0;
+	}
+}
+
+//
+// In our double-buffered DMA scheme, this ISR refills
+// the idle buffer with new samples and rewinds its
+// DMA channel, even as the other DMA continues
+// to pump the other buffer's samples through the PWM.
+//
+template <int Bits, int MaxVoices, int Window, int Channels, unsigned Irq>
+__not_in_flash("picomix") void Mixer<Bits, MaxVoices, Window, Channels, Irq>::service() {
+	renderMode_t mode[MaxVoices];
+	uint32_t startUs = time_us_32();
+
+	ISRcounter++;
+
+	// Acknowledge interrupt, rewind DMA & determine idle side of the double buffer
+	int16_t *idleTxData = transferBuffer[pwm.resetIRQ()].data;
+
+	// Nothing to play? Fill each half with silence once, then leave them be.
+	// The next play() gets rendered into the next block as usual.
+	if (nothingToPlay()) {
+		if (silentHalves < 2) {
+			for (int i = 0; i < Frames * Channels; i++)
+				idleTxData[i] = Range / 2;
+			silentHalves++;
+		} else {
+			idle = true;
+			idleBlocks++;
+		}
+		shedLevel = 0;
+		calmBlocks = 0;
+		frameCount += Frames;
+		return;
+	}
+	silentHalves = 0;
+	idle = false;
+
+	// mix all tracks into the accumulator
+	memset(mixBuf, 0, sizeof(mixBuf));
+	planRender(mode);
+
+	for (int t=0; t<MaxVoices; t++){
+		AudioTrack *track = trk[t];
+		if (track == NULL)
+			continue;
+		if (track->buf == NULL)
+			continue;
+
+#ifdef PTRACE
+		Trc_context(frameCount, t);
+		uint8_t cmds = track->tracedCommands;
+		if (cmds) {
+			track->tracedCommands &= ~cmds;
+			Trc_event(TRACE_COMMAND, 0, cmds);
+		}
+		if (mode[t] == RENDER_DROP && lastMode[t] != RENDER_DROP)
+			Trc_event(TRACE_STEAL, 0, shedLevel);
+		lastMode[t] = mode[t];
+#endif
+
+		if (! track->playing)
+			continue;
+
+		switch (mode[t]) {
+			case RENDER_DROP:
+				track->skip(Frames);
+				break;
+			case RENDER_DECIMATE:
+				track->render<VolumeShift>(mixBuf, Frames, 2);
+				break;
+			default:
+				track->render<VolumeShift>(mixBuf, Frames);
+		}
+	}
+
+	for (int i = 0; i < MIXER_MAX_SOURCES; i++){
+		MixSource *src = sources[i];
+		if (src)
+			src->render(mixBuf, Frames, VolumeShift);
+	}
+
+	// fill idle channel buffer
+	AudioRecorder *rec = tap;
+	if (rec && rec->recording)
+		rec->beginBlock(frameCount);
+	else
+		rec = NULL;
+
+	// interp1 will clamp signed integers to within +/- Range/2
+	// (other Mixers on this core may have their own ideas, so set it every time)
+	interp1->base[0] = 0 - (Range / 2);
+	interp1->base[1] = (Range / 2) - 1;
+
+	for (int i = 0; i < Frames; i++) {
+		interp1->accum[0] = mixBuf[i]; // hard-limit with interpolator
+		int16_t limited = interp1->peek[0];
+
+		// put that sample in all channels
+		for (int j=0; j < Channels; j++)
+			idleTxData[i * Channels + j] = limited + (Range / 2); // shift to positive
+
+		// and maybe record it, at the resolution of our samples
+		if (rec) {
+			if constexpr (Bits >= WAV_PWM_BITS)
+				rec->put(limited >> (Bits - WAV_PWM_BITS));
+			else
+				rec->put(limited << (WAV_PWM_BITS - Bits));
+		}
+	}
+
+	if (rec)
+		rec->endBlock();
+
+	updateGovernor(time_us_32() - startUs);
+	frameCount += Frames;
+}
+
+
+////////////////////////////////////////
+// Picomix: the default Mixer, configured by the #defines at the top of this file.
+//
+class Picomix : public Mixer<WAV_PWM_BITS, MAX_TRACKS, TRANSFER_WINDOW_XFERS, TRANSFER_BUFF_CHANNELS, PWMSTREAMER_DMA_INTERRUPT> {
+
+	///////////////////////////////
+	// This section implements the singleton pattern for c++:
+	// https://stackoverflow.com/questions/1008019/how-do-you-implement-the-singleton-design-pattern
+public:
+	static Picomix& onlyInstance(){
+		static Picomix singleGuy;
+		return singleGuy;
+	}
+private:
+	Picomix() {}
+public:
+	Picomix(Picomix const&)     = delete;
+	void operator=(Picomix const&)  = delete;
+	//
+	// end singleton section
+	///////////////////////////////
 };
 
 
@@ -0,0 +1,180 @@
+// SampleBank -- many samples in one file, for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "SampleBank.h"
+
+// Read a whole bank file at once.
+bool SampleBank::load(fs::FS &fs, String filename){
+	clear();
+
+	File f = fs.open(filename, "r");
+  if (!f) {
+    Dbg_println("file open failed");
+		return false;
+  }
+
+	uint32_t len = f.size();
+	loaded = new uint32_t[(len + 3) / 4]; // word-aligned, so the payloads are too
+	uint32_t got = f.read((uint8_t *)loaded, len);
+	f.close();
+
+	if (got != len) {
+		Dbg_println("bank read failure");
+		clear();
+		return false;
+	}
+	if (! open((const uint8_t *)loaded, len)) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+// Use a bank image in place.  It must be SAMPLEBANK_ALIGN-aligned
+// and built at our WAV_PWM_BITS, since we can't rescale it.
+bool SampleBank::map(const void *img, uint32_t len){
+	clear();
+	if (((uintptr_t)img % SAMPLEBANK_ALIGN) != 0) {
+		Dbg_println("bank image isn't aligned");
+		return false;
+	}
+	if (! open((const uint8_t *)img, len)) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+// Check the bank over & make an AudioBuffer for each sample.
+bool SampleBank::open(const uint8_t *img, uint32_t len){
+	const SampleBankHeader *h = (const SampleBankHeader *)img;
+
+	if (len < sizeof(SampleBankHeader) || h->magic != SAMPLEBANK_MAGIC || h->version != SAMPLEBANK_VERSION) {
+		Dbg_println("not a sample bank");
+		return false;
+	}
+	// (sizes are checked in 64 bits, so a damaged header can't wrap them around)
+	if (h->fileSize > len
+			|| (h->indexOffset % SAMPLEBANK_ALIGN) != 0 || (h->hashOffset % SAMPLEBANK_ALIGN) != 0
+			|| h->indexOffset + (uint64_t)h->count * sizeof(SampleBankEntry) > h->fileSize
+			|| h->hashOffset + (uint64_t)h->hashSlots * sizeof(uint16_t) > h->fileSize
+			|| h->hashSlots == 0 || (h->hashSlots & (h->hashSlots - 1)) != 0) {
+		Dbg_println("sample bank is damaged");
+		return false;
+	}
+
+	// every name lookup lands on an index entry (or 0, for none):
+	const uint16_t *slots = (const uint16_t *)(img + h->hashOffset);
+	for (int s = 0; s < h->hashSlots; s++){
+		if (slots[s] > h->count) {
+			Dbg_println("sample bank hash table is damaged");
+			return false;
+		}
+	}
+
+	const SampleBankEntry *e = (const SampleBankEntry *)(img + h->indexOffset);
+	for (int i = 0; i < h->count; i++){
+		if ((e[i].offset % SAMPLEBANK_ALIGN) != 0 || e[i].channels == 0
+				|| e[i].offset + (uint64_t)e[i].frames * e[i].channels * BYTES_PER_SAMPLE > h->fileSize
+				|| ((e[i].flags & SAMPLEBANK_FLAG_LOOP)
+					&& (e[i].loopLen == 0 || e[i].loopStart >= e[i].frames || e[i].loopLen > e[i].frames - e[i].loopStart))) {
+			Dbg_printf("sample bank entry %d is damaged\n", i);
+			return false;
+		}
+	}
+
+	if (h->bits != WAV_PWM_BITS) {
+		if (img != (const uint8_t *)loaded || h->bits < WAV_PWM_BITS) {
+			Dbg_printf("sample bank is %d-bit, not %d-bit\n", h->bits, WAV_PWM_BITS);
+			return false;
+		}
+		// It's our copy, so we can scale it down in place:
+		for (int i = 0; i < h->count; i++){
+			int16_t *d = (int16_t *)(img + e[i].offset);
+			for (uint32_t s = 0; s < e[i].frames * e[i].channels; s++)
+				d[s] = d[s] >> (h->bits - WAV_PWM_BITS);
+		}
+	}
+
+	image = img;
+	header = h;
+	index = e;
+	hash = (const uint16_t *)(img + h->hashOffset);
+
+	buffers = new AudioBuffer*[h->count];
+	for (int i = 0; i < h->count; i++){
+		buffers[i] = new AudioBuffer(e[i].channels, e[i].frames, (int16_t *)(img + e[i].offset));
+		buffers[i]->sampleStart = 0;
+		buffers[i]->sampleLen = e[i].frames;
+	}
+	return true;
+}
+
+// (Don't clear a bank that tracks are still playing.)
+void SampleBank::clear(){
+	if (buffers) {
+		for (int i = 0; i < header->count; i++)
+			delete buffers[i];
+		delete[] buffers;
+	}
+	delete[] loaded;
+
+	buffers = NULL;
+	loaded = NULL;
+	image = NULL;
+	header = NULL;
+	index = NULL;
+	hash = NULL;
+}
+
+// Index of the sample with this name, or -1.
+int SampleBank::find(const char *name){
+	if (header == NULL)
+		return -1;
+
+	uint16_t mask = header->hashSlots - 1;
+	uint32_t slot = sampleBankHash(name) & mask;
+	for (int probes = 0; probes < header->hashSlots; probes++){
+		uint16_t i = hash[slot];
+		if (i == 0 || i > header->count)
+			return -1;
+		if (strncmp(index[i - 1].name, name, SAMPLEBANK_NAME_LEN) == 0)
+			return i - 1;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+const SampleBankEntry *SampleBank::entry(int i){
+	if (header == NULL || i < 0 || i >= header->count)
+		return NULL;
+	return &index[i];
+}
+
+AudioBuffer *SampleBank::buffer(int i){
+	if (header == NULL || i < 0 || i >= header->count)
+		return NULL;
+	return buffers[i];
+}
+
+AudioTrack *SampleBank::newTrack(int i){
+	const SampleBankEntry *e = entry(i);
+	if (e == NULL)
+		return NULL;
+
+	AudioTrack *t = new AudioTrack(buffers[i]);
+	if (e->flags & SAMPLEBANK_FLAG_LOOP) {
+		// play from the top, then loop
+		t->setLoopRegion(e->loopStart, e->loopLen);
+		t->setLoops(LOOPFOREVER);
+	}
+	return t;
+}
+
+float SampleBank::speedFor(int i, float note){
+	const SampleBankEntry *e = entry(i);
+	if (e == NULL)
+		return 1.0;
+	return pow(2.0, (note - e->rootNote / 256.0) / 12.0);
+}
@@ -0,0 +1,59 @@
+#ifndef __SAMPLEBANK_H
+#define __SAMPLEBANK_H
+
+// SampleBank -- many samples in one file, for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "Picomix.h"
+#include "SampleBankFormat.h"
+
+////////////////
+// SampleBank: a set of samples, with loop points & root pitches,
+// packed into one file by the mkbank tool (see extras/mkbank).
+//
+// load() reads the whole bank with one sequential read into one allocation.
+// map() uses a bank image that's already in memory or flash (e.g. compiled into
+// your sketch with mkbank -H) without copying anything; don't write to those buffers.
+//
+// Samples are found by index, or by name through the bank's hash table.
+// Either way, each one is an AudioBuffer that tracks can play directly.
+//
+class SampleBank {
+public:
+	SampleBank() {};
+	~SampleBank(){
+		clear();
+	};
+
+	SampleBank(SampleBank const&)     = delete;
+	void operator=(SampleBank const&)  = delete;
+
+	bool load(fs::FS &fs, String filename);
+	bool map(const void *image, uint32_t len);
+	void clear();
+
+	int count() { return header ? header->count : 0; };
+	int find(const char *name);
+	const SampleBankEntry *entry(int index);
+	AudioBuffer *buffer(int index);
+
+	// A new track for this sample.  If it has loop points, it plays from the top,
+	// then loops over them:
+	AudioTrack *newTrack(int index);
+
+	// The speed that plays this sample at a MIDI note:
+	float speedFor(int index, float note);
+
+private:
+	const uint8_t *image = NULL;		// the whole bank
+	uint32_t *loaded = NULL;				// our copy of it, if we loaded it
+	const SampleBankHeader *header = NULL;
+	const SampleBankEntry *index = NULL;
+	const uint16_t *hash = NULL;
+	AudioBuffer **buffers = NULL;
+
+	bool open(const uint8_t *img, uint32_t len);
+};
+
+#endif  // __SAMPLEBANK_H
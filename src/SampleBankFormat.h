@@ -0,0 +1,68 @@
+#ifndef __SAMPLEBANKFORMAT_H
+#define __SAMPLEBANKFORMAT_H
+
+// SampleBankFormat -- file layout of Picomix sample banks
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+//
+// This header is shared by SampleBank (on the RP2040) and the mkbank tool (on your computer),
+// so it only depends on <stdint.h>.
+//
+// A bank is one little-endian file:
+//
+//   SampleBankHeader
+//   SampleBankEntry[count]         -- the index, in the order samples were added
+//   uint16_t[hashSlots]            -- name lookup table: open addressing, linear probing,
+//                                     holding (index + 1), or 0 for an empty slot
+//   sample payloads                -- each SAMPLEBANK_ALIGN-aligned, signed 16-bit,
+//                                     already scaled down to header.bits of resolution
+//
+// All offsets are from the start of the file.
+
+#include <stdint.h>
+
+#define SAMPLEBANK_MAGIC 0x42584D50 	// "PMXB"
+#define SAMPLEBANK_VERSION 1
+#define SAMPLEBANK_NAME_LEN 24				// including the terminating NUL
+#define SAMPLEBANK_ALIGN 4
+
+#define SAMPLEBANK_FLAG_LOOP 1				// loopStart & loopLen are meaningful
+
+struct SampleBankHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;					// number of samples
+	uint8_t bits;						// payload resolution (WAV_PWM_BITS of the builder)
+	uint8_t reserved;
+	uint16_t hashSlots;			// a power of 2
+	uint32_t indexOffset;
+	uint32_t hashOffset;
+	uint32_t dataOffset;
+	uint32_t fileSize;
+};
+
+struct SampleBankEntry {
+	char name[SAMPLEBANK_NAME_LEN];
+	uint32_t offset;				// of this sample's payload
+	uint32_t frames;				// length in frames
+	uint32_t loopStart;			// in frames
+	uint32_t loopLen;				// in frames
+	uint16_t rootNote;			// MIDI note number * 256, at speed 1.0
+	uint8_t channels;
+	uint8_t flags;					// SAMPLEBANK_FLAG_*
+};
+
+static_assert(sizeof(SampleBankHeader) == 28, "SampleBankHeader must be packed");
+static_assert(sizeof(SampleBankEntry) == 44, "SampleBankEntry must be packed");
+
+// FNV-1a, for the name lookup table:
+static inline uint32_t sampleBankHash(const char *name){
+	uint32_t h = 2166136261u;
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+#endif  // __SAMPLEBANKFORMAT_H
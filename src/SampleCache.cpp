@@ -0,0 +1,152 @@
+// SampleCache -- shared, reference-counted sample loading for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "SampleCache.h"
+
+SampleCache::Entry *SampleCache::find(const String &filename){
+	for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+		if (entry[i].buf != NULL && entry[i].path == filename)
+			return &entry[i];
+	}
+	return NULL;
+}
+
+void SampleCache::evict(Entry *e){
+	used -= e->buf->byteLen();
+	delete e->buf;
+	e->buf = NULL;
+	e->path = "";
+	e->refs = 0;
+	evictions++;
+}
+
+// The least-recently-used sample that nobody is playing, or NULL.
+SampleCache::Entry *SampleCache::leastRecent(){
+	Entry *lru = NULL;
+	for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+		if (entry[i].buf == NULL || entry[i].refs > 0)
+			continue;
+		if (lru == NULL || (clock - entry[i].lastUse) > (clock - lru->lastUse))
+			lru = &entry[i];
+	}
+	return lru;
+}
+
+// Evict least-recently-used, unreferenced samples until there's a free slot
+// and enough budget for this many more bytes.
+bool SampleCache::makeRoom(uint32_t bytes){
+	if (bytes > budget)
+		return false;
+
+	for (;;) {
+		bool slotFree = false;
+		for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+			if (entry[i].buf == NULL) {
+				slotFree = true;
+				break;
+			}
+		}
+
+		if (slotFree && used + bytes <= budget)
+			return true;
+
+		Entry *lru = leastRecent();
+		if (lru == NULL) // everything left is in use
+			return false;
+		evict(lru);
+	}
+}
+
+SampleCache::Entry *SampleCache::load(const String &filename){
+	File f = fs.open(filename, "r");
+  if (!f) {
+    Dbg_println("file open failed");
+		return NULL;
+  }
+
+	// presuming mono, like Picomix::addTrack()
+	uint32_t bytes = (f.size() / BYTES_PER_SAMPLE) * BYTES_PER_SAMPLE;
+	if (bytes == 0 || ! makeRoom(bytes)) {
+		Dbg_printf("%s: no room in sample cache for %d bytes\n", filename.c_str(), bytes);
+		f.close();
+		return NULL;
+	}
+
+	Entry *e = NULL;
+	for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+		if (entry[i].buf == NULL) {
+			e = &entry[i];
+			break;
+		}
+	}
+
+	e->buf = new AudioBuffer(1, bytes / BYTES_PER_SAMPLE);
+	e->buf->fillFromRawStream(f);
+	f.close();
+
+	e->path = filename;
+	e->refs = 0;
+	used += e->buf->byteLen();
+	return e;
+}
+
+AudioBuffer *SampleCache::acquire(String filename){
+	Entry *e = find(filename);
+	if (e) {
+		hits++;
+	} else {
+		misses++;
+		e = load(filename);
+		if (e == NULL)
+			return NULL;
+	}
+
+	e->refs++;
+	e->lastUse = ++clock;
+	return e->buf;
+}
+
+void SampleCache::release(AudioBuffer *b){
+	for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+		if (entry[i].buf == b) {
+			if (entry[i].refs > 0)
+				entry[i].refs--;
+			else
+				Dbg_println("sample cache: release() without acquire()");
+			return;
+		}
+	}
+}
+
+// Load a sample ahead of time, so a later acquire() doesn't touch the filesystem.
+// It's unreferenced, so it may be evicted again if memory gets tight.
+bool SampleCache::prefetch(String filename){
+	Entry *e = find(filename);
+	if (e == NULL)
+		e = load(filename);
+	if (e == NULL)
+		return false;
+
+	e->lastUse = ++clock;
+	return true;
+}
+
+// Shrinking the budget evicts unreferenced samples right away;
+// referenced ones stay put until they're released & something else needs the room.
+void SampleCache::setBudget(uint32_t budgetBytes){
+	budget = budgetBytes;
+	while (used > budget) {
+		Entry *lru = leastRecent();
+		if (lru == NULL)
+			break;
+		evict(lru);
+	}
+}
+
+void SampleCache::flush(){
+	for (int i=0; i<SAMPLECACHE_SLOTS; i++){
+		if (entry[i].buf != NULL && entry[i].refs == 0)
+			evict(&entry[i]);
+	}
+}
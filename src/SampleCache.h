@@ -0,0 +1,83 @@
+#ifndef __SAMPLECACHE_H
+#define __SAMPLECACHE_H
+
+// SampleCache -- shared, reference-counted sample loading for Picomix
+// This project is Open Source!
+// License: https://creativecommons.org/licenses/by-sa/4.0/
+
+#include "Picomix.h"
+
+//////////////////////////
+// Tweakable:
+//
+// SAMPLECACHE_SLOTS: how many different files the cache can hold at once.
+#define SAMPLECACHE_SLOTS 64
+//
+/////////////////////////
+
+
+////////////////
+// SampleCache: loads raw sample files into AudioBuffers, once.
+//
+// Every track that plays "blorp.raw" shares the same buffer.
+// Buffers are reference-counted: acquire() takes a reference and release() gives it back.
+// Unreferenced buffers stay cached until their memory is needed for something else,
+// and then the least-recently-used ones are evicted first.
+//
+// The memory budget only counts sample data. A load that would go over budget
+// evicts what it can, and fails if that's not enough.
+//
+// Use it from the main loop (or core1), never from the ISR.
+//
+class SampleCache {
+public:
+	SampleCache(fs::FS &filesystem, uint32_t budgetBytes):
+		fs(filesystem),
+		budget(budgetBytes)
+		{};
+
+	// (Release all your tracks' samples before destroying the cache.)
+	~SampleCache(){
+		flush();
+	};
+
+	SampleCache(SampleCache const&)     = delete;
+	void operator=(SampleCache const&)  = delete;
+
+	AudioBuffer *acquire(String filename);	// load if needed & take a reference; NULL on failure
+	void release(AudioBuffer *b);						// give a reference back
+	bool prefetch(String filename);					// load now without taking a reference
+
+	void setBudget(uint32_t budgetBytes);
+	uint32_t getBudget() { return budget; };
+	uint32_t bytesUsed() { return used; };
+
+	void flush();														// evict everything that's not in use
+
+	// some stats:
+	unsigned long hits = 0;
+	unsigned long misses = 0;
+	unsigned long evictions = 0;
+
+private:
+	struct Entry {
+		String path;
+		AudioBuffer *buf = NULL;
+		uint16_t refs = 0;
+		uint32_t lastUse = 0;
+	};
+
+	fs::FS &fs;
+	uint32_t budget;
+	uint32_t used = 0;
+	uint32_t clock = 0;		// ticks once per lookup, for LRU
+	Entry entry[SAMPLECACHE_SLOTS];
+
+	Entry *find(const String &filename);
+	Entry *load(const String &filename);
+	Entry *leastRecent();
+	bool makeRoom(uint32_t bytes);
+	void evict(Entry *e);
+};
+
+#endif  // __SAMPLECACHE_H